@@ -0,0 +1,945 @@
+/// @file benchmarks.cpp
+/// Timing harness for the priority queue implementations.
+///
+/// Usage: ./bench.exe [name|all] [n]
+/// Each benchmark prints one line per configuration with the element count
+/// and the wall clock time in milliseconds.
+
+#include "priorityqueue.h"
+#include "dary_priorityqueue.h"
+#include "pairing_priorityqueue.h"
+#include "radix_priorityqueue.h"
+#include "bucket_priorityqueue.h"
+#include "wheel_priorityqueue.h"
+#include "concurrent_priorityqueue.h"
+#include "skiplist_priorityqueue.h"
+#include "multi_priorityqueue.h"
+#include "stealing_priorityqueue.h"
+#include "combining_priorityqueue.h"
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Upper bound for inputs that drive the unbalanced tree into O(n^2).
+static const int DEGENERATE_LIMIT = 20000;
+
+template<typename F>
+double timeMs(F&& body) {
+    auto start = chrono::steady_clock::now();
+    body();
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+void report(const string& name, int n, double ms) {
+    cout << name << " n=" << n << ": " << ms << " ms" << endl;
+}
+
+vector<int> makePriorities(const string& order, int n) {
+    vector<int> priorities(n);
+    for (int i = 0; i < n; i++) {
+        priorities[i] = i;
+    }
+    if (order == "descending") {
+        reverse(priorities.begin(), priorities.end());
+    }
+    else if (order == "random") {
+        mt19937 gen(251);
+        shuffle(priorities.begin(), priorities.end(), gen);
+    }
+    return priorities;
+}
+
+//
+// balance: enqueue then drain n elements for ascending, descending and
+// random priority streams, unbalanced BST vs the AVL policy.
+//
+template<typename PQ>
+double enqueueDequeue(const vector<int>& priorities) {
+    return timeMs([&]() {
+        PQ pq;
+        for (int pr : priorities) {
+            pq.enqueue(pr, pr);
+        }
+        long long sum = 0;
+        while (pq.Size() > 0) {
+            sum += pq.dequeue();
+        }
+        if (sum < 0) {
+            cout << sum;
+        }
+    });
+}
+
+void benchBalance(int n) {
+    for (string order : {"ascending", "descending", "random"}) {
+        int plainN = order == "random" ? n : min(n, DEGENERATE_LIMIT);
+        report("balance/unbalanced/" + order, plainN,
+               enqueueDequeue<priorityqueue<int>>(makePriorities(order, plainN)));
+        report("balance/avl/" + order, n,
+               enqueueDequeue<avl_priorityqueue<int>>(makePriorities(order, n)));
+    }
+}
+
+//
+// heap: random enqueue/dequeue churn on the AVL tree vs the d-ary heaps.
+// The queue is filled to n and then each step dequeues one and enqueues one.
+//
+template<typename PQ>
+double churn(const vector<int>& priorities) {
+    return timeMs([&]() {
+        PQ pq;
+        for (int pr : priorities) {
+            pq.enqueue(pr, pr);
+        }
+        long long sum = 0;
+        for (int pr : priorities) {
+            sum += pq.dequeue();
+            pq.enqueue(pr, pr + sum % 64);
+        }
+        while (pq.Size() > 0) {
+            sum += pq.dequeue();
+        }
+        if (sum < 0) {
+            cout << sum;
+        }
+    });
+}
+
+void benchHeap(int n) {
+    vector<int> priorities = makePriorities("random", n);
+    report("heap/avl", n, churn<avl_priorityqueue<int>>(priorities));
+    report("heap/dary2", n, churn<dary_priorityqueue<int, 2>>(priorities));
+    report("heap/dary4", n, churn<dary_priorityqueue<int, 4>>(priorities));
+    report("heap/dary8", n, churn<dary_priorityqueue<int, 8>>(priorities));
+}
+
+//
+// dups: n enqueues spread over three priorities, so every insert after the
+// first few lands on a long duplicate list.
+//
+void benchDuplicates(int n) {
+    report("dups/enqueue", n, timeMs([&]() {
+        priorityqueue<int> pq;
+        for (int i = 0; i < n; i++) {
+            pq.enqueue(i, i % 3);
+        }
+    }));
+}
+
+//
+// move: n 1KB string payloads through enqueue/dequeue, copying lvalues vs
+// moving rvalues vs emplacing.  Payload copies are counted alongside time.
+//
+struct payload {
+    static long long copies;
+    string data;
+
+    payload() {}
+    explicit payload(string data) : data(std::move(data)) {}
+    payload(const payload& other) : data(other.data) { copies++; }
+    payload(payload&& other) noexcept : data(std::move(other.data)) {}
+    payload& operator=(const payload& other) {
+        data = other.data;
+        copies++;
+        return *this;
+    }
+    payload& operator=(payload&& other) noexcept {
+        data = std::move(other.data);
+        return *this;
+    }
+};
+long long payload::copies = 0;
+
+void benchMove(int n) {
+    vector<int> priorities = makePriorities("random", n);
+    string text(1024, 'p');
+    size_t total = 0;
+
+    payload::copies = 0;
+    double ms = timeMs([&]() {
+        avl_priorityqueue<payload> pq;
+        for (int pr : priorities) {
+            payload item(text);
+            pq.enqueue(item, pr);
+        }
+        while (pq.Size() > 0) {
+            total += pq.dequeue().data.size();
+        }
+    });
+    report("move/copy-in (copies=" + to_string(payload::copies) + ")", n, ms);
+
+    payload::copies = 0;
+    ms = timeMs([&]() {
+        avl_priorityqueue<payload> pq;
+        for (int pr : priorities) {
+            pq.enqueue(payload(text), pr);
+        }
+        while (pq.Size() > 0) {
+            total += pq.dequeue().data.size();
+        }
+    });
+    report("move/move-in (copies=" + to_string(payload::copies) + ")", n, ms);
+
+    payload::copies = 0;
+    ms = timeMs([&]() {
+        avl_priorityqueue<payload> pq;
+        for (int pr : priorities) {
+            pq.emplace(pr, text);
+        }
+        while (pq.Size() > 0) {
+            total += pq.dequeue().data.size();
+        }
+    });
+    report("move/emplace (copies=" + to_string(payload::copies) + ")", n, ms);
+    if (total == 0) {
+        cout << total;
+    }
+}
+
+//
+// copy: snapshot an n element queue with the structural copy constructor vs
+// rebuilding it with one enqueue per element (the old operator=).
+//
+void benchCopy(int n) {
+    avl_priorityqueue<int> source;
+    for (int pr : makePriorities("random", n)) {
+        source.enqueue(pr, pr % (n / 4 + 1));
+    }
+    long long total = 0;
+    report("copy/structural", n, timeMs([&]() {
+        avl_priorityqueue<int> copy(source);
+        total += copy.Size();
+    }));
+    report("copy/re-enqueue", n, timeMs([&]() {
+        avl_priorityqueue<int> copy;
+        for (int pr : makePriorities("random", n)) {
+            copy.enqueue(pr, pr % (n / 4 + 1));
+        }
+        total += copy.Size();
+    }));
+    report("copy/move", n, timeMs([&]() {
+        avl_priorityqueue<int> moved(std::move(source));
+        total += moved.Size();
+    }));
+    if (total == 0) {
+        cout << total;
+    }
+}
+
+//
+// stress: n sorted inserts into the AVL tree and n inserts onto a single
+// duplicate list, then copy, ==, toString and clear.  Run with n=10000000
+// to check that nothing recurses on the depth of the tree or list.
+//
+template<typename PQ>
+void stressRun(const string& name, int n, bool sameKey) {
+    PQ pq;
+    report("stress/" + name + "/enqueue", n, timeMs([&]() {
+        for (int i = 0; i < n; i++) {
+            pq.enqueue(i, sameKey ? 0 : i);
+        }
+    }));
+    report("stress/" + name + "/copy+==", n, timeMs([&]() {
+        PQ copy(pq);
+        if (!(copy == pq)) {
+            cout << "copy differs" << endl;
+        }
+    }));
+    size_t length = 0;
+    report("stress/" + name + "/toString", n, timeMs([&]() {
+        length = pq.toString().size();
+    }));
+    report("stress/" + name + "/clear", n, timeMs([&]() {
+        pq.clear();
+    }));
+    if (length == 0) {
+        cout << length;
+    }
+}
+
+void benchStress(int n) {
+    stressRun<avl_priorityqueue<int>>("avl-sorted", n, false);
+    stressRun<priorityqueue<int>>("one-priority", n, true);
+}
+
+//
+// bulk: startup from an n element backlog, one enqueue per item vs the range
+// constructor, for a backlog sorted by priority and a shuffled one.
+//
+void benchBulk(int n) {
+    vector<pair<int, int>> sorted(n);
+    for (int i = 0; i < n; i++) {
+        sorted[i] = {i / 4, i};
+    }
+    vector<pair<int, int>> shuffled = sorted;
+    mt19937 gen(251);
+    shuffle(shuffled.begin(), shuffled.end(), gen);
+
+    int plainN = min(n, DEGENERATE_LIMIT);
+    report("bulk/sorted/enqueue-loop unbalanced", plainN, timeMs([&]() {
+        priorityqueue<int> pq;
+        for (int i = 0; i < plainN; i++) {
+            pq.enqueue(sorted[i].second, sorted[i].first);
+        }
+    }));
+    for (auto* backlog : {&sorted, &shuffled}) {
+        string name = backlog == &sorted ? "sorted" : "shuffled";
+        report("bulk/" + name + "/enqueue-loop avl", n, timeMs([&]() {
+            avl_priorityqueue<int> pq;
+            for (auto& [pr, value] : *backlog) {
+                pq.enqueue(value, pr);
+            }
+        }));
+        report("bulk/" + name + "/range-ctor", n, timeMs([&]() {
+            priorityqueue<int> pq(backlog->begin(), backlog->end());
+        }));
+        report("bulk/" + name + "/dary4 range-ctor", n, timeMs([&]() {
+            dary_priorityqueue<int> pq(backlog->begin(), backlog->end());
+        }));
+    }
+}
+
+//
+// batch: drain n elements in batches of 64 and 512, dequeue() in a loop vs
+// dequeue_n, on the unbalanced and the AVL tree.
+//
+template<typename PQ>
+void batchRun(const string& name, const vector<int>& priorities, size_t batch) {
+    vector<int> out;
+    PQ loopQueue;
+    PQ batchQueue;
+    for (int pr : priorities) {
+        loopQueue.enqueue(pr, pr);
+        batchQueue.enqueue(pr, pr);
+    }
+    int n = (int)priorities.size();
+    report("batch/" + name + "/" + to_string(batch) + "/dequeue-loop", n, timeMs([&]() {
+        while (loopQueue.Size() > 0) {
+            out.clear();
+            for (size_t i = 0; i < batch && loopQueue.Size() > 0; i++) {
+                out.push_back(loopQueue.dequeue());
+            }
+        }
+    }));
+    report("batch/" + name + "/" + to_string(batch) + "/dequeue_n", n, timeMs([&]() {
+        while (batchQueue.Size() > 0) {
+            out.clear();
+            batchQueue.dequeue_n(batch, back_inserter(out));
+        }
+    }));
+}
+
+void benchBatch(int n) {
+    vector<int> priorities = makePriorities("random", n);
+    for (size_t batch : {(size_t)64, (size_t)512}) {
+        batchRun<priorityqueue<int>>("unbalanced", priorities, batch);
+        batchRun<avl_priorityqueue<int>>("avl", priorities, batch);
+    }
+}
+
+//
+// min: average latency of peek() and of dequeue() followed by an enqueue
+// with a random priority that refills the queue, at several tree sizes.
+//
+template<typename PQ>
+void minRun(const string& name, int size) {
+    PQ pq;
+    vector<int> priorities = makePriorities("random", size);
+    for (int pr : priorities) {
+        pq.enqueue(pr, pr);
+    }
+    const int ops = 1000000;
+    vector<int> refill(ops);
+    mt19937 gen(size);
+    for (int& pr : refill) {
+        pr = (int)(gen() % (unsigned)(4 * size));
+    }
+    long long sum = 0;
+    // Read through a volatile pointer so the peek cannot be hoisted.
+    PQ* volatile target = &pq;
+    double peekMs = timeMs([&]() {
+        for (int i = 0; i < ops; i++) {
+            sum += target->peek();
+        }
+    });
+    double dequeueMs = timeMs([&]() {
+        for (int i = 0; i < ops; i++) {
+            int value = pq.dequeue();
+            sum += value;
+            pq.enqueue(value, refill[i]);
+        }
+    });
+    cout << "min/" << name << " size=" << size << ": peek " << peekMs * 1e6 / ops
+         << " ns, dequeue+enqueue " << dequeueMs * 1e6 / ops << " ns" << endl;
+    if (sum == 0) {
+        cout << sum;
+    }
+}
+
+void benchMin(int n) {
+    for (int size = 1000; size <= n; size *= 10) {
+        minRun<priorityqueue<int>>("unbalanced", size);
+        minRun<avl_priorityqueue<int>>("avl", size);
+    }
+}
+
+//
+// merge: combine two shards of n/2 elements each with merge() vs draining
+// one into the other, and merging a 1% shard into a large one.
+//
+void benchMerge(int n) {
+    vector<int> priorities = makePriorities("random", n);
+    auto fill = [&](avl_priorityqueue<int>& pq, int from, int to) {
+        for (int i = from; i < to; i++) {
+            pq.enqueue(priorities[i], priorities[i] % (n / 8 + 1));
+        }
+    };
+    {
+        avl_priorityqueue<int> a, b;
+        fill(a, 0, n / 2);
+        fill(b, n / 2, n);
+        report("merge/halves/dequeue-enqueue", n, timeMs([&]() {
+            while (b.Size() > 0) {
+                int value = b.dequeue();
+                a.enqueue(value, value % (n / 8 + 1));
+            }
+        }));
+    }
+    {
+        avl_priorityqueue<int> a, b;
+        fill(a, 0, n / 2);
+        fill(b, n / 2, n);
+        report("merge/halves/merge", n, timeMs([&]() {
+            a.merge(std::move(b));
+        }));
+    }
+    {
+        avl_priorityqueue<int> a, b;
+        fill(a, 0, n - n / 100);
+        fill(b, n - n / 100, n);
+        report("merge/1%-shard/merge", n, timeMs([&]() {
+            a.merge(std::move(b));
+        }));
+    }
+}
+
+void splitRun(const string& name, int n, int threshold) {
+    vector<int> priorities = makePriorities("random", n);
+    {
+        avl_priorityqueue<int> pq, lower, upper;
+        for (int priority : priorities) {
+            pq.enqueue(priority, priority);
+        }
+        report("split/" + name + "/dequeue-enqueue", n, timeMs([&]() {
+            while (pq.Size() > 0) {
+                int value = pq.dequeue();
+                (value > threshold ? upper : lower).enqueue(value, value);
+            }
+        }));
+    }
+    {
+        avl_priorityqueue<int> pq;
+        for (int priority : priorities) {
+            pq.enqueue(priority, priority);
+        }
+        int moved = 0;
+        report("split/" + name + "/split", n, timeMs([&]() {
+            avl_priorityqueue<int> upper = pq.split(threshold);
+            moved = upper.Size();
+        }));
+        if (moved + pq.Size() != n) {
+            cout << "split/" + name + ": lost elements" << endl;
+        }
+    }
+}
+
+void benchSplit(int n) {
+    splitRun("top-1%", n, n - n / 100);
+    splitRun("halves", n, n / 2);
+}
+
+// Random sparse digraph in compressed adjacency form: DEGREE random edges
+// per vertex plus a chain 0 -> 1 -> ... so every vertex is reachable.
+struct graph {
+    static const int DEGREE = 8;
+    vector<int> first;  // edges of u are first[u] .. first[u + 1]
+    vector<int> target;
+    vector<int> weight;
+
+    explicit graph(int n) : first(n + 1) {
+        mt19937 gen(251);
+        for (int u = 0; u < n; u++) {
+            first[u] = (int)target.size();
+            if (u + 1 < n) {
+                target.push_back(u + 1);
+                weight.push_back(1000);
+            }
+            for (int e = 0; e < DEGREE; e++) {
+                target.push_back((int)(gen() % n));
+                weight.push_back(1 + (int)(gen() % 1000));
+            }
+        }
+        first[n] = (int)target.size();
+    }
+};
+
+// Dijkstra with decrease-key through handles: each vertex is queued once.
+template<typename PQ>
+long long dijkstraHandles(const graph& g, int n) {
+    PQ pq;
+    vector<typename PQ::handle> handles(n);
+    vector<int> dist(n, -1);
+    vector<char> done(n, 0);
+    dist[0] = 0;
+    handles[0] = pq.enqueue(0, 0);
+    while (pq.Size() > 0) {
+        int u = pq.dequeue();
+        done[u] = 1;
+        for (int e = g.first[u]; e < g.first[u + 1]; e++) {
+            int v = g.target[e];
+            int candidate = dist[u] + g.weight[e];
+            if (dist[v] == -1) {
+                dist[v] = candidate;
+                handles[v] = pq.enqueue(v, candidate);
+            }
+            else if (!done[v] && candidate < dist[v]) {
+                dist[v] = candidate;
+                pq.update_priority(handles[v], candidate);
+            }
+        }
+    }
+    long long total = 0;
+    for (int d : dist) {
+        total += d;
+    }
+    return total;
+}
+
+// Dijkstra with lazy deletion: improved distances are pushed again and stale
+// entries are skipped when they surface.
+long long dijkstraLazy(const graph& g, int n) {
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+    vector<int> dist(n, -1);
+    dist[0] = 0;
+    pq.push({0, 0});
+    while (!pq.empty()) {
+        auto [d, u] = pq.top();
+        pq.pop();
+        if (d != dist[u]) {
+            continue;
+        }
+        for (int e = g.first[u]; e < g.first[u + 1]; e++) {
+            int v = g.target[e];
+            int candidate = d + g.weight[e];
+            if (dist[v] == -1 || candidate < dist[v]) {
+                dist[v] = candidate;
+                pq.push({candidate, v});
+            }
+        }
+    }
+    long long total = 0;
+    for (int d : dist) {
+        total += d;
+    }
+    return total;
+}
+
+void benchDijkstra(int n) {
+    graph g(n);
+    long long handles = 0;
+    long long pairing = 0;
+    long long lazy = 0;
+    report("dijkstra/avl+update_priority", n, timeMs([&]() {
+        handles = dijkstraHandles<avl_priorityqueue<int>>(g, n);
+    }));
+    report("dijkstra/pairing+update_priority", n, timeMs([&]() {
+        pairing = dijkstraHandles<pairing_priorityqueue<int>>(g, n);
+    }));
+    report("dijkstra/std::priority_queue+lazy", n, timeMs([&]() {
+        lazy = dijkstraLazy(g, n);
+    }));
+    if (handles != lazy || pairing != lazy) {
+        cout << "dijkstra: distances differ" << endl;
+    }
+}
+
+// Timer queue: n pending timers; each step fires the earliest one and arms
+// a new one a random delay after it, so priorities only move forward.  The
+// value is the deadline itself.
+template<typename PQ>
+double timerRun(int n) {
+    mt19937 gen(251);
+    PQ pq;
+    for (int i = 0; i < n; i++) {
+        int deadline = (int)(gen() % 1000);
+        pq.enqueue(deadline, deadline);
+    }
+    return timeMs([&]() {
+        for (int i = 0; i < n; i++) {
+            int now = pq.dequeue();
+            int deadline = now + 1 + (int)(gen() % 1000);
+            pq.enqueue(deadline, deadline);
+        }
+    });
+}
+
+void benchRadix(int n) {
+    report("radix/timers/priorityqueue", n, timerRun<priorityqueue<int>>(n));
+    report("radix/timers/avl", n, timerRun<avl_priorityqueue<int>>(n));
+    report("radix/timers/dary4", n, timerRun<dary_priorityqueue<int, 4>>(n));
+    report("radix/timers/radix", n, timerRun<radix_priorityqueue<int>>(n));
+}
+
+// Steady state traffic on priorities 0-255: n queued, then n steps of one
+// dequeue and one enqueue.
+template<typename PQ>
+double smallRangeRun(int n) {
+    mt19937 gen(251);
+    PQ pq;
+    for (int i = 0; i < n; i++) {
+        pq.enqueue(i, (int)(gen() % 256));
+    }
+    return timeMs([&]() {
+        for (int i = 0; i < n; i++) {
+            int value = pq.dequeue();
+            pq.enqueue(value, (int)(gen() % 256));
+        }
+    });
+}
+
+void benchBucket(int n) {
+    report("bucket/0-255/priorityqueue", n, smallRangeRun<priorityqueue<int>>(n));
+    report("bucket/0-255/avl", n, smallRangeRun<avl_priorityqueue<int>>(n));
+    report("bucket/0-255/dary4", n, smallRangeRun<dary_priorityqueue<int, 4>>(n));
+    report("bucket/0-255/bucket", n, smallRangeRun<bucket_priorityqueue<int>>(n));
+}
+
+// Short lived timers: every tick arms one timer 1-1000 ticks out and
+// cancels, nine times out of ten, the one armed 50 ticks earlier if it has
+// not fired yet; then time advances by one tick.  Returns the # fired.
+size_t wheelTimers(int n) {
+    mt19937 gen(251);
+    wheel_priorityqueue<int> wheel;
+    vector<wheel_priorityqueue<int>::handle> handles(n);
+    vector<char> pending(n, 0);
+    size_t fired = 0;
+    for (int t = 0; t < n; t++) {
+        handles[t] = wheel.enqueue(t, (unsigned long long)t + 1 + gen() % 1000);
+        pending[t] = 1;
+        if (t >= 50 && pending[t - 50] && gen() % 10 != 0) {
+            wheel.cancel(handles[t - 50]);
+            pending[t - 50] = 0;
+        }
+        fired += wheel.advance_to(t, [&](int id) {
+            pending[id] = 0;
+        });
+    }
+    return fired;
+}
+
+size_t treeTimers(int n) {
+    mt19937 gen(251);
+    avl_priorityqueue<int> tree;
+    vector<avl_priorityqueue<int>::handle> handles(n);
+    vector<char> pending(n, 0);
+    vector<int> due;
+    size_t fired = 0;
+    for (int t = 0; t < n; t++) {
+        handles[t] = tree.enqueue(t, t + 1 + (int)(gen() % 1000));
+        pending[t] = 1;
+        if (t >= 50 && pending[t - 50] && gen() % 10 != 0) {
+            tree.erase(handles[t - 50]);
+            pending[t - 50] = 0;
+        }
+        due.clear();
+        tree.drain_until(t, back_inserter(due));
+        for (int id : due) {
+            pending[id] = 0;
+        }
+        fired += due.size();
+    }
+    return fired;
+}
+
+void benchWheel(int n) {
+    size_t wheelFired = 0;
+    size_t treeFired = 0;
+    report("wheel/short-timers/avl+erase", n, timeMs([&]() {
+        treeFired = treeTimers(n);
+    }));
+    report("wheel/short-timers/wheel", n, timeMs([&]() {
+        wheelFired = wheelTimers(n);
+    }));
+    if (wheelFired != treeFired) {
+        cout << "wheel: fired counts differ" << endl;
+    }
+}
+
+// The baseline for the thread safe queues: every call behind one mutex.
+template<typename T, typename PQ = priorityqueue<T>>
+class lockedqueue {
+public:
+    void enqueue(const T& value, int priority) {
+        lock_guard<mutex> guard(lock);
+        pq.enqueue(value, priority);
+    }
+
+    bool try_dequeue(T& valueOut) {
+        lock_guard<mutex> guard(lock);
+        return pq.try_dequeue(valueOut);
+    }
+
+private:
+    mutex lock;
+    PQ pq;
+};
+
+// n operations split over the given # of threads; each thread alternates an
+// enqueue at a random priority in 0-1023 with a dequeue, on a queue that
+// starts with 10000 elements.
+template<typename PQ>
+double threadedRun(PQ& pq, int n, int threads) {
+    mt19937 gen(251);
+    for (int i = 0; i < 10000; i++) {
+        pq.enqueue(i, (int)(gen() % 1024));
+    }
+    return timeMs([&]() {
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&pq, n, threads, t]() {
+                mt19937 local(t);
+                int value;
+                for (int i = 0; i < n / threads / 2; i++) {
+                    pq.enqueue(i, (int)(local() % 1024));
+                    pq.try_dequeue(value);
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    });
+}
+
+// The threadedRun workload with a priority no other enqueue uses, like
+// timestamps: every enqueue creates a new bucket in the bucket queue.
+template<typename PQ>
+double distinctRun(PQ& pq, int n, int threads) {
+    for (int i = 0; i < 10000; i++) {
+        pq.enqueue(i, i * threads);
+    }
+    return timeMs([&]() {
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&pq, n, threads, t]() {
+                int value;
+                for (int i = 0; i < n / threads / 2; i++) {
+                    pq.enqueue(i, (10000 + i) * threads + t);
+                    pq.try_dequeue(value);
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    });
+}
+
+void benchConcurrent(int n) {
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        string suffix = "/" + to_string(threads) + "-threads";
+        {
+            lockedqueue<int> pq;
+            report("concurrent/mutex" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            concurrent_priorityqueue<int> pq;
+            report("concurrent/buckets" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            skiplist_priorityqueue<int> pq;
+            report("concurrent/skiplist" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            // ascending priorities would degenerate the unbalanced tree
+            lockedqueue<int, avl_priorityqueue<int>> pq;
+            report("concurrent/distinct/mutex" + suffix, n, distinctRun(pq, n, threads));
+        }
+        {
+            concurrent_priorityqueue<int> pq;
+            report("concurrent/distinct/buckets" + suffix, n, distinctRun(pq, n, threads));
+        }
+        {
+            skiplist_priorityqueue<int> pq;
+            report("concurrent/distinct/skiplist" + suffix, n, distinctRun(pq, n, threads));
+        }
+    }
+}
+
+// Scalability of the relaxed MultiQueue against the strict mutex queue on
+// the threadedRun workload, with the sampled rank error of a second run
+// showing what the relaxation costs in order.
+void benchMultiQueue(int n) {
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        string suffix = "/" + to_string(threads) + "-threads";
+        {
+            lockedqueue<int> pq;
+            report("multiqueue/mutex" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            multi_priorityqueue<int> pq(2, threads);
+            report("multiqueue/c=2" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            multi_priorityqueue<int> pq(2, threads);
+            pq.sample_rank_error(1000);
+            threadedRun(pq, n, threads);
+            auto stats = pq.rank_error_stats();
+            cout << "multiqueue/c=2" << suffix << " rank error: mean " << stats.mean
+                 << ", max " << stats.max << " over " << stats.samples << " samples" << endl;
+        }
+    }
+}
+
+// Fan-out jobs: one root job, and every job spawns two children a little
+// later in priority until n jobs exist, like a parallel search expanding
+// its frontier.  Idle workers yield, as a scheduler's would.  enqueue(worker, job, priority) and tryDequeue(worker, job)
+// adapt the queue under test.
+template<typename Enqueue, typename TryDequeue>
+double fanOutRun(int n, int threads, Enqueue enqueue, TryDequeue tryDequeue) {
+    atomic<int> spawned(1);
+    atomic<int> done(0);
+    enqueue(0, 0, 0);
+    return timeMs([&]() {
+        vector<thread> workers;
+        for (int w = 0; w < threads; w++) {
+            workers.emplace_back([&, w]() {
+                mt19937 local(w);
+                int job;
+                while (done.load(memory_order_relaxed) < n) {
+                    if (!tryDequeue(w, job)) {
+                        this_thread::yield();
+                        continue;
+                    }
+                    for (int child = 0; child < 2; child++) {
+                        int id = spawned.fetch_add(1, memory_order_relaxed);
+                        if (id >= n) {
+                            break;
+                        }
+                        enqueue(w, id, job / 2 + (int)(local() % 64));
+                    }
+                    done.fetch_add(1, memory_order_relaxed);
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    });
+}
+
+void benchStealing(int n) {
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        string suffix = "/" + to_string(threads) + "-threads";
+        {
+            lockedqueue<int, avl_priorityqueue<int>> pq;
+            report("stealing/fan-out/mutex" + suffix, n, fanOutRun(n, threads,
+                [&](int, int job, int priority) { pq.enqueue(job, priority); },
+                [&](int, int& job) { return pq.try_dequeue(job); }));
+        }
+        // A slack of 64 keeps every worker within about one spawn step of
+        // the best job around; a huge one only steals when a shard runs dry.
+        for (auto [name, slack] : {pair<string, int>{"slack-64", 64}, {"steal-when-empty", 1 << 30}}) {
+            stealing_priorityqueue<int> pq(threads, slack);
+            report("stealing/fan-out/per-worker/" + name + suffix, n, fanOutRun(n, threads,
+                [&](int w, int job, int priority) { pq.enqueue(job, priority, w); },
+                [&](int w, int& job) { return pq.try_dequeue(job, w); }));
+        }
+    }
+}
+
+void benchCombining(int n) {
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        string suffix = "/" + to_string(threads) + "-threads";
+        {
+            lockedqueue<int> pq;
+            report("combining/mutex" + suffix, n, threadedRun(pq, n, threads));
+        }
+        {
+            combining_priorityqueue<int> pq;
+            report("combining/flat-combining" + suffix, n, threadedRun(pq, n, threads));
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string which = argc > 1 ? argv[1] : "all";
+    int n = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    if (which == "all" || which == "balance") {
+        benchBalance(n);
+    }
+    if (which == "all" || which == "heap") {
+        benchHeap(n);
+    }
+    if (which == "all" || which == "dups") {
+        benchDuplicates(n);
+    }
+    if (which == "all" || which == "move") {
+        benchMove(n);
+    }
+    if (which == "all" || which == "copy") {
+        benchCopy(n);
+    }
+    if (which == "all" || which == "stress") {
+        benchStress(n);
+    }
+    if (which == "all" || which == "bulk") {
+        benchBulk(n);
+    }
+    if (which == "all" || which == "batch") {
+        benchBatch(n);
+    }
+    if (which == "all" || which == "min") {
+        benchMin(n);
+    }
+    if (which == "all" || which == "merge") {
+        benchMerge(n);
+    }
+    if (which == "all" || which == "split") {
+        benchSplit(n);
+    }
+    if (which == "all" || which == "dijkstra") {
+        benchDijkstra(n);
+    }
+    if (which == "all" || which == "radix") {
+        benchRadix(n);
+    }
+    if (which == "all" || which == "bucket") {
+        benchBucket(n);
+    }
+    if (which == "all" || which == "wheel") {
+        benchWheel(n);
+    }
+    if (which == "all" || which == "concurrent") {
+        benchConcurrent(n);
+    }
+    if (which == "all" || which == "multiqueue") {
+        benchMultiQueue(n);
+    }
+    if (which == "all" || which == "stealing") {
+        benchStealing(n);
+    }
+    if (which == "all" || which == "combining") {
+        benchCombining(n);
+    }
+    return 0;
+}
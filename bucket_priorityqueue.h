@@ -0,0 +1,376 @@
+//  @file bucket_priorityqueue.h
+//  @brief Bucket queue for small integer priority ranges with the same
+//  enqueue/dequeue/peek/Size interface as priorityqueue.
+//  @description Priorities are ints in [0, N).  Every priority has its own
+//  FIFO list, so elements with equal priorities come out in the order they
+//  were enqueued, exactly as the custom BST's duplicate link lists give
+//  them.  A two level bitmap marks the non-empty lists: bit i of summary is
+//  set when words[i] is not zero, bit j of words[i] when list 64 * i + j is
+//  not empty.  The minimum is found with two countr_zero calls, so enqueue,
+//  dequeue and peek are all O(1) for any N up to 4096.  Nodes come from the
+//  same nodepool as priorityqueue's.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template<typename T, int N = 256, typename Alloc = std::allocator<T>>
+class bucket_priorityqueue {
+    static_assert(N > 0 && N <= 64 * 64, "priority range must be 1 .. 4096");
+
+private:
+    struct NODE {
+        T value;  // stored data for the p-queue
+        NODE* next;  // next NODE with the same priority
+    };
+    struct LIST {
+        NODE* head;  // first NODE, dequeued next
+        NODE* tail;  // last NODE, enqueue appends after it
+    };
+    static constexpr int WORDS = (N + 63) / 64;
+
+    LIST lists[N];  // one FIFO list per priority
+    unsigned long long words[WORDS];  // bit j of words[i]: lists[64 * i + j] not empty
+    unsigned long long summary;  // bit i: words[i] not zero
+    int size;  // # of elements in the pqueue
+    nodepool<NODE, Alloc> pool;  // storage for every NODE
+
+    // Returns the smallest priority with a non-empty list; the queue must
+    // not be empty.
+    // O(1)
+    int minPriority() const {
+        int word = countr_zero(summary);
+        return word * 64 + countr_zero(words[word]);
+    }
+
+    // Returns the smallest priority >= from with a non-empty list, or N.
+    // O(1)
+    int nextPriority(int from) const {
+        if (from >= N) {
+            return N;
+        }
+        int word = from / 64;
+        unsigned long long bits = words[word] & (~0ULL << (from % 64));
+        if (bits != 0) {
+            return word * 64 + countr_zero(bits);
+        }
+        unsigned long long above = word + 1 < 64 ? summary & (~0ULL << (word + 1)) : 0;
+        if (above == 0) {
+            return N;
+        }
+        word = countr_zero(above);
+        return word * 64 + countr_zero(words[word]);
+    }
+
+    void markNonEmpty(int priority) {
+        words[priority / 64] |= 1ULL << (priority % 64);
+        summary |= 1ULL << (priority / 64);
+    }
+
+    void markEmpty(int priority) {
+        words[priority / 64] &= ~(1ULL << (priority % 64));
+        if (words[priority / 64] == 0) {
+            summary &= ~(1ULL << (priority / 64));
+        }
+    }
+
+    void reset() {
+        for (LIST& list : lists) {
+            list.head = nullptr;
+            list.tail = nullptr;
+        }
+        for (unsigned long long& word : words) {
+            word = 0;
+        }
+        summary = 0;
+        size = 0;
+    }
+
+public:
+    //
+    // default / allocator constructors:
+    //
+    // Creates an empty priority queue.
+    // O(N / 64)
+    //
+    bucket_priorityqueue() {
+        reset();
+    }
+
+    explicit bucket_priorityqueue(const Alloc& alloc) : pool(alloc) {
+        reset();
+    }
+
+    //
+    // Copying is not supported; moving takes over the nodes.
+    // O(N)
+    //
+    bucket_priorityqueue(const bucket_priorityqueue&) = delete;
+    bucket_priorityqueue& operator=(const bucket_priorityqueue&) = delete;
+
+    bucket_priorityqueue(bucket_priorityqueue&& other) noexcept : pool(std::move(other.pool)) {
+        std::copy(std::begin(other.lists), std::end(other.lists), std::begin(lists));
+        std::copy(std::begin(other.words), std::end(other.words), std::begin(words));
+        summary = other.summary;
+        size = other.size;
+        other.reset();
+    }
+
+    bucket_priorityqueue& operator=(bucket_priorityqueue&& other) noexcept {
+        if (this != &other) {
+            clear();
+            pool.swap(other.pool);
+            std::copy(std::begin(other.lists), std::end(other.lists), std::begin(lists));
+            std::copy(std::begin(other.words), std::end(other.words), std::begin(words));
+            summary = other.summary;
+            size = other.size;
+            other.reset();
+        }
+        return *this;
+    }
+
+    ~bucket_priorityqueue() {
+        clear();
+    }
+
+    //
+    // clear:
+    //
+    // Removes every element.
+    // O(chunks) when T is trivially destructible, otherwise O(n)
+    //
+    void clear() {
+        if (!is_trivially_destructible<T>::value) {
+            for (LIST& list : lists) {
+                for (NODE* node = list.head; node != nullptr;) {
+                    NODE* next = node->next;
+                    node->~NODE();
+                    node = next;
+                }
+            }
+        }
+        pool.release();
+        reset();
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Appends the value to the list of its priority, which must be in
+    // [0, N); debug builds assert this.  emplace constructs the value in
+    // place.
+    // O(1)
+    //
+    void enqueue(const T& value, int priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, int priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(int priority, Args&&... args) {
+        assert(priority >= 0 && priority < N && "bucket_priorityqueue: priority out of range");
+        void* memory = pool.allocate();
+        NODE* node;
+        try {
+            node = ::new (memory) NODE{T(std::forward<Args>(args)...), nullptr};
+        }
+        catch (...) {
+            pool.deallocate(memory);
+            throw;
+        }
+        LIST& list = lists[priority];
+        if (list.tail == nullptr) {
+            list.head = node;
+            markNonEmpty(priority);
+        }
+        else {
+            list.tail->next = node;
+        }
+        list.tail = node;
+        size++;
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  The value is moved, not copied.
+    // Returns T() when empty.
+    // O(1)
+    //
+    T dequeue() {
+        if (size == 0) {
+            return T();
+        }
+        int priority = minPriority();
+        LIST& list = lists[priority];
+        NODE* node = list.head;
+        list.head = node->next;
+        if (list.head == nullptr) {
+            list.tail = nullptr;
+            markEmpty(priority);
+        }
+        size--;
+        T valueOut = std::move(node->value);
+        node->~NODE();
+        pool.deallocate(node);
+        return valueOut;
+    }
+
+    //
+    // peek:
+    //
+    // returns a reference to the value of the next element in the priority
+    // queue but does not remove the item from the priority queue.
+    // O(1)
+    //
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
+        return lists[minPriority()].head->value;
+    }
+
+    //
+    // try_peek / try_dequeue:
+    //
+    // Same as in priorityqueue: false (or an empty optional) for an empty
+    // queue, without constructing a T.
+    //
+    bool try_peek(T& valueOut) const {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = peek();
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (size == 0) {
+            return nullopt;
+        }
+        return peek();
+    }
+
+    bool try_dequeue(T& valueOut) {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (size == 0) {
+            return nullopt;
+        }
+        return dequeue();
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.
+    // O(1)
+    //
+    int Size() const {
+        return size;
+    }
+
+    //
+    // const_iterator
+    //
+    // Forward iterator over the queue in priority order, equal priorities in
+    // the order they were enqueued, like priorityqueue's.  Dereferencing
+    // yields a (priority, const T&) pair; value_type is a plain (priority, T)
+    // pair.  Moving to the next non-empty list uses the bitmap, so an
+    // increment is O(1).
+    //
+    class const_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using iterator_concept = forward_iterator_tag;
+        using value_type = pair<int, T>;
+        using reference = entry_ref<int, const T&>;
+        using difference_type = ptrdiff_t;
+
+        // Holds the reference pair so that it->first and it->second work.
+        struct pointer {
+            reference entry;
+
+            const reference* operator->() const {
+                return &entry;
+            }
+        };
+
+        const_iterator() : queue(nullptr), priority(N), node(nullptr) {
+        }
+
+        reference operator*() const {
+            return reference(priority, node->value);
+        }
+
+        pointer operator->() const {
+            return pointer{**this};
+        }
+
+        const_iterator& operator++() {
+            node = node->next;
+            if (node == nullptr) {
+                priority = queue->nextPriority(priority + 1);
+                node = priority < N ? queue->lists[priority].head : nullptr;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator before = *this;
+            ++*this;
+            return before;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return node == other.node;
+        }
+
+    private:
+        friend class bucket_priorityqueue;
+
+        const_iterator(const bucket_priorityqueue* queue, int priority)
+            : queue(queue), priority(priority),
+              node(priority < N ? queue->lists[priority].head : nullptr) {
+        }
+
+        const bucket_priorityqueue* queue;  // queue being walked
+        int priority;  // priority of the current list, N at the end
+        NODE* node;  // current element
+    };
+
+    //
+    // begin / end:
+    //
+    // Iterators to the first element and one past the last one.
+    // O(1)
+    //
+    const_iterator begin() const {
+        return const_iterator(this, nextPriority(0));
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+};
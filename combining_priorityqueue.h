@@ -0,0 +1,362 @@
+//  @file combining_priorityqueue.h
+//  @brief Flat-combining wrapper around priorityqueue with the same
+//  enqueue/dequeue/peek/Size interface as concurrent_priorityqueue.
+//  @description Under heavy contention a mutex makes every thread take its
+//  turn at the queue, bouncing the lock and the tree's cache lines between
+//  cores once per operation.  With flat combining a thread instead posts
+//  its request in a publication record and tries to become the combiner;
+//  the one that succeeds applies every pending request to the sequential
+//  avl_priorityqueue in one pass while the others wait on their own record.
+//  The tree stays in the combiner's cache, and a pass turns into batch
+//  operations: all enqueues go in with one enqueue_bulk and all dequeues
+//  come out with one dequeue_n.  Within a pass the enqueues are applied
+//  before the peeks and the dequeues, which is a valid order for requests
+//  that were all pending at once; requests of one thread are applied in
+//  the order it made them, so equal priorities keep their enqueue order.
+//  An exception thrown while applying a request goes to the thread that
+//  made it; the requests applied before it are done, and the ones after
+//  it wait for the next pass.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>>
+class combining_priorityqueue {
+private:
+    static constexpr int MAX_THREADS = 128;  // requests that can be pending at once
+    static constexpr int PASSES = 4;  // passes a combiner makes while it finds work
+    static constexpr size_t BULK_MIN = 8;  // fewer enqueues are linked one by one
+
+    enum OPERATION { ENQUEUE, PEEK, DEQUEUE };
+    enum STATE { IDLE, PENDING, DONE };
+
+    // A publication record.  The requesting thread owns it from claiming it
+    // until its request is DONE; the fields besides state are only read and
+    // written by the combiner in between.
+    struct alignas(64) RECORD {
+        atomic<bool> busy{false};  // claimed by a thread
+        atomic<int> state{IDLE};  // STATE of the posted request
+        OPERATION op = ENQUEUE;
+        pair<Priority, T>* entry = nullptr;  // ENQUEUE: the element, moved from
+        T* out = nullptr;  // PEEK, DEQUEUE: where the value goes
+        bool found = false;  // PEEK, DEQUEUE: the queue had an element
+        exception_ptr error;  // thrown while the request's pass was applied
+    };
+
+    RECORD records[MAX_THREADS];
+    atomic<int> used;  // records[0, used) have been claimed at some point
+    atomic<bool> combining;  // held by the combiner
+    atomic<int> size;  // # of elements, published before requests are marked DONE
+    avl_priorityqueue<T, Priority, Compare> pq;  // guarded by combining
+
+    // Scratch space of the combiner, kept between passes.
+    vector<RECORD*> enqueues;
+    vector<RECORD*> peeks;
+    vector<RECORD*> dequeues;
+    vector<pair<Priority, T>> batch;
+    vector<T> popped;
+
+    RECORD& claim() {
+        // Threads probe from the front, so combiners only scan as many
+        // records as threads ever ran requests at once.
+        thread_local unsigned hint = 0;
+        for (unsigned i = hint;; i++) {
+            int index = (int)(i % MAX_THREADS);
+            RECORD& record = records[index];
+            bool idle = false;
+            if (!record.busy.load(memory_order_relaxed) &&
+                record.busy.compare_exchange_strong(idle, true, memory_order_acquire)) {
+                hint = index;
+                int seen = used.load(memory_order_relaxed);
+                while (seen <= index &&
+                       !used.compare_exchange_weak(seen, index + 1, memory_order_release)) {
+                }
+                return record;
+            }
+            if (i - hint == MAX_THREADS - 1) {
+                this_thread::yield();
+                i = hint - 1;
+            }
+        }
+    }
+
+    // Posts the request in the record and waits until some combiner, maybe
+    // this thread, has applied it, then gives the record up.  Returns its
+    // found flag, or rethrows what applying it threw.
+    bool post(RECORD& record) {
+        record.error = nullptr;
+        record.state.store(PENDING, memory_order_release);
+        while (record.state.load(memory_order_acquire) != DONE) {
+            if (!combining.load(memory_order_relaxed) &&
+                !combining.exchange(true, memory_order_acquire)) {
+                combine();
+                combining.store(false, memory_order_release);
+            }
+            else {
+                this_thread::yield();
+            }
+        }
+        record.state.store(IDLE, memory_order_relaxed);
+        exception_ptr error = std::move(record.error);
+        bool found = record.found;
+        record.busy.store(false, memory_order_release);
+        if (error != nullptr) {
+            rethrow_exception(error);
+        }
+        return found;
+    }
+
+    // Applies the pending requests, up to PASSES times while there are any.
+    void combine() {
+        for (int pass = 0; pass < PASSES; pass++) {
+            enqueues.clear();
+            peeks.clear();
+            dequeues.clear();
+            int count = used.load(memory_order_acquire);
+            for (int i = 0; i < count; i++) {
+                RECORD& record = records[i];
+                if (record.state.load(memory_order_acquire) == PENDING) {
+                    (record.op == ENQUEUE ? enqueues : record.op == PEEK ? peeks : dequeues).push_back(&record);
+                }
+            }
+            if (enqueues.empty() && peeks.empty() && dequeues.empty()) {
+                return;
+            }
+            apply();
+        }
+    }
+
+    // One pass: the enqueues, then every peek, then the dequeues, marking
+    // each request DONE as soon as it is applied.  If a request throws, it
+    // alone gets the exception and the pass ends there, leaving the
+    // requests after it PENDING.  The batch operations are only used where
+    // they cannot fail halfway through: BULK_MIN or more enqueues go in with
+    // one enqueue_bulk when moving the elements cannot throw (it then either
+    // inserts the whole batch or, short of memory, none of it, and every
+    // request of the batch fails), and the dequeues come out with one
+    // dequeue_n when moving the values out cannot throw.
+    void apply() {
+        constexpr bool nothrowEntry = is_nothrow_move_constructible_v<T> &&
+                                      is_nothrow_copy_constructible_v<Priority>;
+        if (nothrowEntry && enqueues.size() >= BULK_MIN) {
+            try {
+                batch.clear();
+                batch.reserve(enqueues.size());
+                for (RECORD* record : enqueues) {
+                    batch.push_back(std::move(*record->entry));
+                }
+                pq.enqueue_bulk(make_move_iterator(batch.begin()), make_move_iterator(batch.end()));
+            }
+            catch (...) {
+                for (RECORD* record : enqueues) {
+                    fail(record, current_exception());
+                }
+                return;
+            }
+            for (RECORD* record : enqueues) {
+                finish(record);
+            }
+        }
+        else {
+            for (RECORD* record : enqueues) {
+                try {
+                    pq.enqueue(std::move(record->entry->second), record->entry->first);
+                }
+                catch (...) {
+                    fail(record, current_exception());
+                    return;
+                }
+                finish(record);
+            }
+        }
+        for (RECORD* record : peeks) {
+            try {
+                record->found = pq.try_peek(*record->out);
+            }
+            catch (...) {
+                fail(record, current_exception());
+                return;
+            }
+            finish(record);
+        }
+        if (is_nothrow_move_constructible_v<T> && is_nothrow_move_assignable_v<T> &&
+            !dequeues.empty()) {
+            try {
+                popped.clear();
+                popped.reserve(dequeues.size());
+            }
+            catch (...) {
+                fail(dequeues.front(), current_exception());
+                return;
+            }
+            pq.dequeue_n(dequeues.size(), back_inserter(popped));
+            for (size_t i = 0; i < dequeues.size(); i++) {
+                dequeues[i]->found = i < popped.size();
+                if (dequeues[i]->found) {
+                    *dequeues[i]->out = std::move(popped[i]);
+                }
+                finish(dequeues[i]);
+            }
+        }
+        else {
+            for (RECORD* record : dequeues) {
+                try {
+                    record->found = pq.try_dequeue(*record->out);
+                }
+                catch (...) {
+                    fail(record, current_exception());
+                    return;
+                }
+                finish(record);
+            }
+        }
+    }
+
+    // Publishes the size and hands the record back to its thread.
+    void finish(RECORD* record) {
+        size.store(pq.Size(), memory_order_relaxed);
+        record->state.store(DONE, memory_order_release);
+    }
+
+    void fail(RECORD* record, exception_ptr error) {
+        record->error = error;
+        finish(record);
+    }
+
+    bool pop(T& valueOut) {
+        RECORD& record = claim();
+        record.op = DEQUEUE;
+        record.out = &valueOut;
+        return post(record);
+    }
+
+public:
+    //
+    // default constructor:
+    //
+    // Creates an empty priority queue.
+    // O(MAX_THREADS)
+    //
+    combining_priorityqueue() : used(0), combining(false), size(0) {
+    }
+
+    combining_priorityqueue(const combining_priorityqueue&) = delete;
+    combining_priorityqueue& operator=(const combining_priorityqueue&) = delete;
+
+    //
+    // clear:
+    //
+    // Removes every element.  Waits for the combiner in flight.
+    // O(n)
+    //
+    void clear() {
+        while (combining.exchange(true, memory_order_acquire)) {
+            this_thread::yield();
+        }
+        pq.clear();
+        size.store(0, memory_order_relaxed);
+        combining.store(false, memory_order_release);
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority.  The element is built by
+    // the calling thread and moved into the queue by the combiner.
+    // O(logn) amortized over the combiner's batch
+    //
+    void enqueue(const T& value, const Priority& priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, const Priority& priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(const Priority& priority, Args&&... args) {
+        pair<Priority, T> entry(piecewise_construct, forward_as_tuple(priority),
+                                forward_as_tuple(std::forward<Args>(args)...));
+        RECORD& record = claim();
+        record.op = ENQUEUE;
+        record.entry = &entry;
+        post(record);
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  Returns T() when empty.
+    // O(logn) amortized over the combiner's batch
+    //
+    T dequeue() {
+        T valueOut{};
+        pop(valueOut);
+        return valueOut;
+    }
+
+    //
+    // try_dequeue:
+    //
+    // Removes the next element and moves it into valueOut (or the returned
+    // optional).  Returns false (an empty optional) when the queue is empty.
+    //
+    bool try_dequeue(T& valueOut) {
+        return pop(valueOut);
+    }
+
+    optional<T> try_dequeue() {
+        T valueOut{};
+        if (!pop(valueOut)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    //
+    // peek / try_peek:
+    //
+    // Returns a copy of the value of the next element, T() (or an empty
+    // optional) when empty.  Another thread may dequeue it right after.
+    //
+    T peek() {
+        return try_peek().value_or(T());
+    }
+
+    optional<T> try_peek() {
+        T valueOut{};
+        RECORD& record = claim();
+        record.op = PEEK;
+        record.out = &valueOut;
+        if (!post(record)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.  Under
+    // concurrent updates this is a snapshot.
+    // O(1)
+    //
+    int Size() const {
+        return size.load(memory_order_relaxed);
+    }
+};
@@ -0,0 +1,245 @@
+//  @file concurrent_priorityqueue.h
+//  @brief Thread safe priority queue with fine grained locking and the same
+//  enqueue/dequeue/peek/Size interface as priorityqueue.
+//  @description Elements are kept in one FIFO bucket per distinct priority,
+//  each behind its own mutex, so elements with equal priorities come out in
+//  the order they were enqueued, the same order the custom BST's duplicate
+//  link lists give.  The buckets are found through an ordered index behind
+//  a shared_mutex that is almost always taken shared: only creating the
+//  bucket for a new priority, or dropping buckets that ran empty, takes it
+//  exclusively, and new readers step aside while a thread waits for that.
+//  Producers at different priorities therefore only share
+//  the index lock in shared mode, and consumers only ever lock the bucket
+//  they pop from, instead of everyone serializing on one global mutex.
+//  Consumers popping the minimum still meet at the minimum's bucket, which
+//  a strict priority queue cannot avoid (see the relaxed variants for
+//  that).  The design pays off only when there are few distinct
+//  priorities, e.g. a handful of levels, so that buckets are created
+//  rarely.  When most enqueues bring a new priority (timestamps, distances)
+//  every one of them takes the index exclusively, producers serialize on
+//  it and the queue is slower than one global mutex; use
+//  skiplist_priorityqueue there (see concurrent/distinct in benchmarks).
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>>
+class concurrent_priorityqueue {
+private:
+    struct BUCKET {
+        mutex lock;  // guards items
+        deque<T> items;  // elements with this priority, oldest first
+    };
+
+    // Dequeue drops the empty buckets in front of the index once it had to
+    // step over this many of them.
+    static constexpr int EMPTY_BUCKETS_LIMIT = 4;
+
+    mutable shared_mutex indexLock;  // exclusive only to add or drop buckets
+    mutable atomic<int> writers;  // # of threads waiting to take indexLock exclusively
+    map<Priority, unique_ptr<BUCKET>, Compare> index;  // guarded by indexLock
+    atomic<int> size;  // # of elements, changed under the bucket's lock
+
+    // Takes indexLock shared once no thread waits to take it exclusively.
+    // glibc's shared_mutex prefers readers, so consumers polling the index
+    // would otherwise keep a producer with a new priority out for good.
+    shared_lock<shared_mutex> readIndex() const {
+        while (writers.load(memory_order_acquire) > 0) {
+            this_thread::yield();
+        }
+        return shared_lock<shared_mutex>(indexLock);
+    }
+
+    // Takes indexLock exclusively, holding new readers off meanwhile.
+    unique_lock<shared_mutex> writeIndex() {
+        writers.fetch_add(1, memory_order_acq_rel);
+        unique_lock<shared_mutex> writer(indexLock);
+        writers.fetch_sub(1, memory_order_release);
+        return writer;
+    }
+
+    // Drops the empty buckets in front of the index, if no other thread is
+    // using it.  A bucket is only ever used under indexLock, so holding it
+    // exclusively makes deleting one safe.
+    void dropEmptyBuckets() {
+        unique_lock<shared_mutex> writer(indexLock, try_to_lock);
+        if (!writer.owns_lock()) {
+            return;
+        }
+        while (!index.empty() && index.begin()->second->items.empty()) {
+            index.erase(index.begin());
+        }
+    }
+
+    // Pops the first element of the first non-empty bucket into valueOut.
+    bool pop(T& valueOut) {
+        if (size.load(memory_order_acquire) == 0) {
+            return false;
+        }
+        int skipped = 0;
+        bool found = false;
+        {
+            shared_lock<shared_mutex> reader = readIndex();
+            for (auto& [priority, bucket] : index) {
+                lock_guard<mutex> guard(bucket->lock);
+                if (!bucket->items.empty()) {
+                    valueOut = std::move(bucket->items.front());
+                    bucket->items.pop_front();
+                    size.fetch_sub(1, memory_order_relaxed);
+                    found = true;
+                    break;
+                }
+                skipped++;
+            }
+        }
+        if (skipped >= EMPTY_BUCKETS_LIMIT) {
+            dropEmptyBuckets();
+        }
+        return found;
+    }
+
+public:
+    //
+    // default / comparator constructors:
+    //
+    // Creates an empty priority queue.
+    // O(1)
+    //
+    concurrent_priorityqueue() : writers(0), size(0) {
+    }
+
+    explicit concurrent_priorityqueue(const Compare& comp) : writers(0), index(comp), size(0) {
+    }
+
+    concurrent_priorityqueue(const concurrent_priorityqueue&) = delete;
+    concurrent_priorityqueue& operator=(const concurrent_priorityqueue&) = delete;
+
+    //
+    // clear:
+    //
+    // Removes every element.  Waits for the operations in flight.
+    // O(n)
+    //
+    void clear() {
+        unique_lock<shared_mutex> writer = writeIndex();
+        index.clear();
+        size.store(0, memory_order_relaxed);
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Appends the value to the bucket of its priority.  Only the first
+    // enqueue of a priority that has no bucket takes the index exclusively,
+    // waiting for every reader and blocking all other threads meanwhile.
+    // O(logp) for p distinct priorities, plus the bucket lock
+    //
+    void enqueue(const T& value, const Priority& priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, const Priority& priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(const Priority& priority, Args&&... args) {
+        {
+            shared_lock<shared_mutex> reader = readIndex();
+            auto found = index.find(priority);
+            if (found != index.end()) {
+                BUCKET& bucket = *found->second;
+                lock_guard<mutex> guard(bucket.lock);
+                bucket.items.emplace_back(std::forward<Args>(args)...);
+                size.fetch_add(1, memory_order_release);
+                return;
+            }
+        }
+        unique_lock<shared_mutex> writer = writeIndex();
+        unique_ptr<BUCKET>& bucket = index[priority];
+        if (bucket == nullptr) {
+            bucket = make_unique<BUCKET>();
+        }
+        bucket->items.emplace_back(std::forward<Args>(args)...);
+        size.fetch_add(1, memory_order_release);
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  Returns T() when empty.
+    // O(logp) plus the empty buckets stepped over, which are then dropped
+    //
+    T dequeue() {
+        T valueOut{};
+        pop(valueOut);
+        return valueOut;
+    }
+
+    //
+    // try_dequeue:
+    //
+    // Removes the next element and moves it into valueOut (or the returned
+    // optional).  Returns false (an empty optional) when the queue is empty.
+    //
+    bool try_dequeue(T& valueOut) {
+        return pop(valueOut);
+    }
+
+    optional<T> try_dequeue() {
+        T valueOut{};
+        if (!pop(valueOut)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    //
+    // peek / try_peek:
+    //
+    // Returns a copy of the value of the next element, T() (or an empty
+    // optional) when empty.  Another thread may dequeue it right after, so
+    // unlike priorityqueue's this is not a reference.
+    //
+    T peek() const {
+        return try_peek().value_or(T());
+    }
+
+    optional<T> try_peek() const {
+        if (size.load(memory_order_acquire) == 0) {
+            return nullopt;
+        }
+        shared_lock<shared_mutex> reader = readIndex();
+        for (auto& [priority, bucket] : index) {
+            lock_guard<mutex> guard(bucket->lock);
+            if (!bucket->items.empty()) {
+                return bucket->items.front();
+            }
+        }
+        return nullopt;
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.  Under
+    // concurrent updates this is a snapshot.
+    // O(1)
+    //
+    int Size() const {
+        return size.load(memory_order_relaxed);
+    }
+};
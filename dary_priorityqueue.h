@@ -0,0 +1,251 @@
+//  @file dary_priorityqueue.h
+//  @brief Array backed d-ary heap with the same enqueue/dequeue/peek/Size
+//  interface as priorityqueue.
+//  @description Elements live in one contiguous vector laid out as an
+//  implicit d-ary heap, so there is no per-element allocation and no pointer
+//  chasing.  Ties between equal priorities are broken by an insertion
+//  sequence number, which keeps the same FIFO order the custom BST gives
+//  through its duplicate link lists.
+
+#pragma once
+
+#include <iterator>
+#include <optional>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+template<typename T, int D = 4>
+class dary_priorityqueue {
+    static_assert(D == 2 || D == 4 || D == 8, "heap arity must be 2, 4 or 8");
+
+private:
+    struct ENTRY {
+        int priority;  // heap key
+        unsigned long long seq;  // insertion order, breaks priority ties
+        T value;  // stored data for the p-queue
+    };
+    vector<ENTRY> heap;  // implicit d-ary heap, children of i are D*i+1 .. D*i+D
+    unsigned long long nextSeq;  // sequence number for the next enqueue
+
+    static bool before(const ENTRY& a, const ENTRY& b) {
+        if (a.priority != b.priority) {
+            return a.priority < b.priority;
+        }
+        return a.seq < b.seq;
+    }
+
+    // Moves the entry at index up until its parent comes before it.
+    void siftUp(size_t index) {
+        ENTRY moving = std::move(heap[index]);
+        while (index > 0) {
+            size_t parent = (index - 1) / D;
+            if (!before(moving, heap[parent])) {
+                break;
+            }
+            heap[index] = std::move(heap[parent]);
+            index = parent;
+        }
+        heap[index] = std::move(moving);
+    }
+
+    // Moves the entry at index down until it comes before all its children.
+    void siftDown(size_t index) {
+        size_t count = heap.size();
+        ENTRY moving = std::move(heap[index]);
+        while (true) {
+            size_t first = index * D + 1;
+            if (first >= count) {
+                break;
+            }
+            size_t last = first + D < count ? first + D : count;
+            size_t best = first;
+            for (size_t child = first + 1; child < last; child++) {
+                if (before(heap[child], heap[best])) {
+                    best = child;
+                }
+            }
+            if (!before(heap[best], moving)) {
+                break;
+            }
+            heap[index] = std::move(heap[best]);
+            index = best;
+        }
+        heap[index] = std::move(moving);
+    }
+
+public:
+    //
+    // default constructor:
+    //
+    // Creates an empty priority queue.
+    // O(1)
+    //
+    dary_priorityqueue() {
+        nextSeq = 0;
+    }
+
+    //
+    // range constructor:
+    //
+    // Creates a queue holding the (priority, value) pairs in [first, last),
+    // see enqueue_bulk.
+    //
+    template<typename InputIt>
+        requires input_iterator<InputIt>
+    dary_priorityqueue(InputIt first, InputIt last) {
+        nextSeq = 0;
+        enqueue_bulk(first, last);
+    }
+
+    //
+    // enqueue_bulk:
+    //
+    // Enqueues every (priority, value) pair in [first, last) in range order.
+    // When the range is at least as large as the current queue the whole
+    // array is heapified bottom-up, otherwise each new entry is sifted up.
+    // O(n + k), where n is the current size and k the length of the range
+    //
+    template<typename InputIt>
+        requires input_iterator<InputIt>
+    void enqueue_bulk(InputIt first, InputIt last) {
+        size_t before = heap.size();
+        if constexpr (forward_iterator<InputIt>) {
+            heap.reserve(before + (size_t)distance(first, last));
+        }
+        for (; first != last; ++first) {
+            auto&& entry = *first;
+            heap.push_back(ENTRY{entry.first, nextSeq++, std::forward<decltype(entry)>(entry).second});
+        }
+        size_t added = heap.size() - before;
+        if (added >= before) {
+            // Floyd's heapify: sift down every internal node, last parent first.
+            if (heap.size() > 1) {
+                for (size_t index = (heap.size() - 2) / D + 1; index-- > 0;) {
+                    siftDown(index);
+                }
+            }
+        }
+        else {
+            for (size_t index = before; index < heap.size(); index++) {
+                siftUp(index);
+            }
+        }
+    }
+
+    //
+    // reserve:
+    //
+    // Preallocates room for n elements so that enqueue never reallocates
+    // while the queue holds at most n elements.
+    //
+    void reserve(size_t n) {
+        heap.reserve(n);
+    }
+
+    //
+    // clear:
+    //
+    // Removes every element, keeping the allocated storage for reuse.
+    // O(n) destructor calls, no deallocation
+    //
+    void clear() {
+        heap.clear();
+        nextSeq = 0;
+    }
+
+    //
+    // enqueue:
+    //
+    // Inserts the value with the given priority.
+    // O(log_D n)
+    //
+    void enqueue(T value, int priority) {
+        heap.push_back(ENTRY{priority, nextSeq++, std::move(value)});
+        siftUp(heap.size() - 1);
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  Returns T() when empty.
+    // O(D log_D n)
+    //
+    T dequeue() {
+        if (heap.empty()) {
+            return T();
+        }
+        T valueOut = std::move(heap.front().value);
+        if (heap.size() > 1) {
+            heap.front() = std::move(heap.back());
+            heap.pop_back();
+            siftDown(0);
+        }
+        else {
+            heap.pop_back();
+        }
+        return valueOut;
+    }
+
+    //
+    // peek:
+    //
+    // returns a reference to the value of the next element in the priority
+    // queue but does not remove the item from the priority queue.  The
+    // reference stays valid until the next enqueue or dequeue.
+    // O(1)
+    //
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
+        return heap.front().value;
+    }
+
+    //
+    // try_peek / try_dequeue:
+    //
+    // Same as in priorityqueue: false (or an empty optional) for an empty
+    // queue, without constructing a T.
+    //
+    bool try_peek(T& valueOut) const {
+        if (heap.empty()) {
+            return false;
+        }
+        valueOut = heap.front().value;
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (heap.empty()) {
+            return nullopt;
+        }
+        return heap.front().value;
+    }
+
+    bool try_dequeue(T& valueOut) {
+        if (heap.empty()) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (heap.empty()) {
+            return nullopt;
+        }
+        return dequeue();
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.
+    // O(1)
+    //
+    int Size() const {
+        return (int)heap.size();
+    }
+};
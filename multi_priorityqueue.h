@@ -0,0 +1,302 @@
+//  @file multi_priorityqueue.h
+//  @brief Relaxed concurrent priority queue (a MultiQueue) with the same
+//  enqueue/dequeue/Size interface as concurrent_priorityqueue.
+//  @description For work that does not need a strict global order, only
+//  "probably among the best few".  The queue is split into c * P shards,
+//  each an avl_priorityqueue behind its own mutex, for P threads; the
+//  balanced tree keeps ascending priorities such as timestamps from
+//  degenerating a shard into a list.  Enqueue puts the element into a
+//  random shard; dequeue looks at the published
+//  minimum priorities of two random shards and pops from the better one.
+//  Locks are only ever tried, never waited for: a thread that finds a shard
+//  busy simply picks another one, so threads hardly ever contend.  The price
+//  is the rank error, the # of elements in the queue that come before the
+//  one a dequeue returns; with two choices its expected value is O(c * P)
+//  no matter how many elements are queued.  The queue can sample it (see
+//  sample_rank_error) to show how relaxed the order really is.  Elements
+//  with equal priorities come out in no particular order, and there is no
+//  peek, which would be as relaxed as dequeue.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>>
+    requires is_trivially_copyable_v<Priority>
+class multi_priorityqueue {
+private:
+    struct alignas(64) SHARD {
+        mutex lock;  // only ever tried
+        avl_priorityqueue<T, Priority, Compare> pq;  // guarded by lock
+        atomic<int> count{0};  // pq.Size(), published for lock free reads
+        atomic<Priority> top{};  // minimum priority in pq when count > 0
+    };
+
+    unique_ptr<SHARD[]> shards;
+    int shardCount;  // # of shards, c * P
+    atomic<int> size;  // # of elements, a snapshot under concurrent updates
+    [[no_unique_address]] Compare comp;  // orders the priorities
+
+    // Rank error sampling, see sample_rank_error.
+    atomic<unsigned> sampleEvery;  // 0 when not sampling
+    mutex statsLock;  // guards the fields below, one measurement at a time
+    unsigned long long samples;  // # of dequeues measured
+    unsigned long long rankSum;  // sum of their rank errors
+    long long rankMax;  // largest rank error seen
+
+    // Per-thread xorshift generator for picking shards.
+    static unsigned long long nextRandom() {
+        thread_local unsigned long long state =
+            hash<thread::id>()(this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // Republishes the shard's size and minimum; call with its lock held.
+    static void publish(SHARD& shard) {
+        int count = shard.pq.Size();
+        if (count > 0) {
+            shard.top.store((*shard.pq.cbegin()).first, memory_order_relaxed);
+        }
+        shard.count.store(count, memory_order_release);
+    }
+
+    // Is shard a's published minimum better than shard b's?  Empty shards
+    // come last.
+    bool better(const SHARD& a, const SHARD& b) const {
+        if (a.count.load(memory_order_acquire) == 0) {
+            return false;
+        }
+        if (b.count.load(memory_order_acquire) == 0) {
+            return true;
+        }
+        return comp(a.top.load(memory_order_relaxed), b.top.load(memory_order_relaxed));
+    }
+
+    // Pops from the better of two random shards, retrying with a fresh pair
+    // while the chosen one is busy or turns out empty.  When both picks are
+    // empty a sweep over every shard makes sure a nearly empty queue still
+    // finds its last elements.
+    bool pop(T& valueOut) {
+        while (size.load(memory_order_acquire) > 0) {
+            SHARD* first = &shards[nextRandom() % shardCount];
+            SHARD* second = &shards[nextRandom() % shardCount];
+            SHARD* chosen = better(*second, *first) ? second : first;
+            if (chosen->count.load(memory_order_acquire) == 0) {
+                chosen = nullptr;
+                for (int i = 0; i < shardCount && chosen == nullptr; i++) {
+                    if (shards[i].count.load(memory_order_acquire) > 0) {
+                        chosen = &shards[i];
+                    }
+                }
+                if (chosen == nullptr) {
+                    this_thread::yield();
+                    continue;
+                }
+            }
+            if (!chosen->lock.try_lock()) {
+                continue;
+            }
+            if (chosen->pq.Size() == 0) {
+                chosen->lock.unlock();
+                continue;
+            }
+            Priority priority = (*chosen->pq.cbegin()).first;
+            valueOut = chosen->pq.dequeue();
+            publish(*chosen);
+            size.fetch_sub(1, memory_order_relaxed);
+            chosen->lock.unlock();
+            unsigned every = sampleEvery.load(memory_order_relaxed);
+            if (every != 0 && nextRandom() % every == 0) {
+                measure(priority);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Records the rank error of a dequeue that returned the given priority:
+    // the # of elements still queued that come before it.  Shards are
+    // locked one at a time, so concurrent updates make this approximate.
+    // O(shards + rank error)
+    void measure(const Priority& priority) {
+        lock_guard<mutex> stats(statsLock);
+        long long rank = 0;
+        for (int i = 0; i < shardCount; i++) {
+            lock_guard<mutex> guard(shards[i].lock);
+            for (auto it = shards[i].pq.cbegin(); it != shards[i].pq.cend(); ++it) {
+                if (!comp((*it).first, priority)) {
+                    break;
+                }
+                rank++;
+            }
+        }
+        samples++;
+        rankSum += rank;
+        rankMax = max(rankMax, rank);
+    }
+
+public:
+    //
+    // rank_error
+    //
+    // Summary of the sampled rank errors; a strict queue has all zeros.
+    //
+    struct rank_error {
+        unsigned long long samples;  // # of dequeues measured
+        double mean;  // average rank error
+        long long max;  // largest rank error
+    };
+
+    //
+    // constructor:
+    //
+    // Creates an empty queue with factor * threads shards (at least one);
+    // threads defaults to the # of hardware threads.  Two to four shards
+    // per thread is the usual trade between contention and rank error.
+    // O(shards)
+    //
+    explicit multi_priorityqueue(int factor = 2, int threads = 0, const Compare& comp = Compare())
+        : size(0), comp(comp), sampleEvery(0), samples(0), rankSum(0), rankMax(0) {
+        if (threads <= 0) {
+            threads = max(1, (int)thread::hardware_concurrency());
+        }
+        shardCount = max(1, factor * threads);
+        shards = make_unique<SHARD[]>(shardCount);
+    }
+
+    multi_priorityqueue(const multi_priorityqueue&) = delete;
+    multi_priorityqueue& operator=(const multi_priorityqueue&) = delete;
+
+    //
+    // clear:
+    //
+    // Removes every element, shard by shard.
+    // O(n)
+    //
+    void clear() {
+        for (int i = 0; i < shardCount; i++) {
+            lock_guard<mutex> guard(shards[i].lock);
+            size.fetch_sub(shards[i].pq.Size(), memory_order_relaxed);
+            shards[i].pq.clear();
+            publish(shards[i]);
+        }
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority into a random shard that is
+    // not busy.
+    // O(logn) for the shard's n elements
+    //
+    void enqueue(const T& value, const Priority& priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, const Priority& priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(const Priority& priority, Args&&... args) {
+        while (true) {
+            SHARD& shard = shards[nextRandom() % shardCount];
+            if (shard.lock.try_lock()) {
+                lock_guard<mutex> guard(shard.lock, adopt_lock);
+                shard.pq.emplace(priority, std::forward<Args>(args)...);
+                publish(shard);
+                size.fetch_add(1, memory_order_release);
+                return;
+            }
+        }
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of an element close to the front of the queue and
+    // removes it: the front element of the better of two random shards.
+    // Returns T() when empty.
+    // O(logn) for the shard's n elements
+    //
+    T dequeue() {
+        T valueOut{};
+        pop(valueOut);
+        return valueOut;
+    }
+
+    //
+    // try_dequeue:
+    //
+    // Same as dequeue, moving the value into valueOut (or the returned
+    // optional).  Returns false (an empty optional) when the queue is empty.
+    //
+    bool try_dequeue(T& valueOut) {
+        return pop(valueOut);
+    }
+
+    optional<T> try_dequeue() {
+        T valueOut{};
+        if (!pop(valueOut)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.  Under
+    // concurrent updates this is a snapshot.
+    // O(1)
+    //
+    int Size() const {
+        return size.load(memory_order_relaxed);
+    }
+
+    //
+    // shard_count:
+    //
+    // Returns the # of shards.
+    // O(1)
+    //
+    int shard_count() const {
+        return shardCount;
+    }
+
+    //
+    // sample_rank_error / rank_error_stats:
+    //
+    // sample_rank_error(k) measures the rank error of about one in k
+    // dequeues from now on (0 stops sampling) and resets the statistics.
+    // Every measurement briefly locks all shards, so keep k large outside
+    // of tests.  rank_error_stats returns what was measured so far.
+    //
+    void sample_rank_error(unsigned every) {
+        lock_guard<mutex> stats(statsLock);
+        samples = 0;
+        rankSum = 0;
+        rankMax = 0;
+        sampleEvery.store(every, memory_order_relaxed);
+    }
+
+    rank_error rank_error_stats() {
+        lock_guard<mutex> stats(statsLock);
+        return rank_error{samples, samples == 0 ? 0.0 : (double)rankSum / samples, rankMax};
+    }
+};
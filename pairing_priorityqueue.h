@@ -0,0 +1,441 @@
+//  @file pairing_priorityqueue.h
+//  @brief Pairing heap with the same enqueue/dequeue/peek/Size interface and
+//  the same handles as priorityqueue.
+//  @description A pairing heap is a heap ordered multiway tree kept as a
+//  child/sibling binary tree.  enqueue and decrease-key are O(1): the node
+//  is simply linked against the root.  dequeue pays for them by pairing up
+//  the root's children in two passes, O(logn) amortized.  That makes it the
+//  better fit for shortest path and event simulation workloads, which issue
+//  far more decrease-keys than dequeues.  Ties between equal priorities are
+//  broken by an insertion sequence number, which keeps the same FIFO order
+//  the custom BST gives through its duplicate link lists.  Nodes come from
+//  the same nodepool as priorityqueue's.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>,
+         typename Alloc = std::allocator<T>>
+class pairing_priorityqueue {
+private:
+    struct NODE {
+        Priority priority;  // heap key
+        unsigned long long seq;  // insertion order, breaks priority ties
+        T value;  // stored data for the p-queue
+        NODE* child;  // first child
+        NODE* sibling;  // next sibling
+        NODE* prev;  // previous sibling, or the parent for a first child
+    };
+    NODE* root;  // node with the minimum priority
+    int size;  // # of elements in the pqueue
+    unsigned long long nextSeq;  // sequence number for the next enqueue
+    nodepool<NODE, Alloc> pool;  // storage for every NODE
+    [[no_unique_address]] Compare comp;  // orders the priorities
+
+    bool before(const NODE* a, const NODE* b) const {
+        if (comp(a->priority, b->priority)) {
+            return true;
+        }
+        if (comp(b->priority, a->priority)) {
+            return false;
+        }
+        return a->seq < b->seq;
+    }
+
+    // Makes the later of two roots the first child of the earlier one and
+    // returns the earlier one.  Siblings of the roots are ignored.
+    NODE* link(NODE* a, NODE* b) {
+        if (before(b, a)) {
+            std::swap(a, b);
+        }
+        b->prev = a;
+        b->sibling = a->child;
+        if (a->child != nullptr) {
+            a->child->prev = b;
+        }
+        a->child = b;
+        return a;
+    }
+
+    // Cuts node, with its subtree, out of its parent's child list.
+    static void cut(NODE* node) {
+        if (node->prev->child == node) {
+            node->prev->child = node->sibling;
+        }
+        else {
+            node->prev->sibling = node->sibling;
+        }
+        if (node->sibling != nullptr) {
+            node->sibling->prev = node->prev;
+        }
+        node->prev = nullptr;
+        node->sibling = nullptr;
+    }
+
+    // Melds a list of siblings into one tree with the standard two passes:
+    // pair them up left to right, then link the pairs right to left.  The
+    // first pass pushes the pairs onto a stack threaded through sibling, so
+    // neither pass recurses.
+    // O(logn) amortized
+    NODE* combine(NODE* first) {
+        if (first == nullptr) {
+            return nullptr;
+        }
+        NODE* pairs = nullptr;
+        while (first != nullptr) {
+            NODE* a = first;
+            NODE* b = a->sibling;
+            if (b == nullptr) {
+                a->sibling = pairs;
+                pairs = a;
+                break;
+            }
+            first = b->sibling;
+            NODE* winner = link(a, b);
+            winner->sibling = pairs;
+            pairs = winner;
+        }
+        NODE* result = pairs;
+        pairs = pairs->sibling;
+        while (pairs != nullptr) {
+            NODE* next = pairs->sibling;
+            result = link(result, pairs);
+            pairs = next;
+        }
+        result->prev = nullptr;
+        result->sibling = nullptr;
+        return result;
+    }
+
+    // Takes node out of the heap without destroying it.
+    void detach(NODE* node) {
+        if (node == root) {
+            root = combine(node->child);
+        }
+        else {
+            cut(node);
+            NODE* subtree = combine(node->child);
+            if (subtree != nullptr) {
+                root = link(root, subtree);
+            }
+        }
+        node->child = nullptr;
+        size--;
+    }
+
+    // Adds a detached node as a one node tree.
+    void attach(NODE* node) {
+        node->child = nullptr;
+        node->sibling = nullptr;
+        node->prev = nullptr;
+        root = root == nullptr ? node : link(root, node);
+        root->prev = nullptr;
+        root->sibling = nullptr;
+        size++;
+    }
+
+    template<typename... Args>
+    NODE* createNode(const Priority& priority, Args&&... args) {
+        void* memory = pool.allocate();
+        try {
+            return ::new (memory) NODE{priority, nextSeq++, T(std::forward<Args>(args)...),
+                                       nullptr, nullptr, nullptr};
+        }
+        catch (...) {
+            pool.deallocate(memory);
+            throw;
+        }
+    }
+
+    void destroyNode(NODE* node) {
+        node->~NODE();
+        pool.deallocate(node);
+    }
+
+public:
+    //
+    // handle
+    //
+    // Refers to one element, as returned by enqueue and emplace, for
+    // update_priority and erase.  Valid until the element is dequeued or
+    // erased (or the queue is cleared or destroyed).
+    //
+    class handle {
+    public:
+        handle() : node(nullptr) {
+        }
+
+        const Priority& priority() const {
+            return node->priority;
+        }
+
+        const T& value() const {
+            return node->value;
+        }
+
+        bool operator==(const handle& other) const {
+            return node == other.node;
+        }
+
+    private:
+        friend class pairing_priorityqueue;
+
+        explicit handle(NODE* node) : node(node) {
+        }
+
+        NODE* node;  // the element's node, which never moves in memory
+    };
+
+    //
+    // default / allocator / comparator constructors:
+    //
+    // Creates an empty priority queue.
+    // O(1)
+    //
+    pairing_priorityqueue() : root(nullptr), size(0), nextSeq(0) {
+    }
+
+    explicit pairing_priorityqueue(const Alloc& alloc)
+        : root(nullptr), size(0), nextSeq(0), pool(alloc) {
+    }
+
+    explicit pairing_priorityqueue(const Compare& comp, const Alloc& alloc = Alloc())
+        : root(nullptr), size(0), nextSeq(0), pool(alloc), comp(comp) {
+    }
+
+    //
+    // Copying is not supported: handles could not follow the copy.  Moving
+    // takes over the nodes, so handles stay valid.
+    // O(1)
+    //
+    pairing_priorityqueue(const pairing_priorityqueue&) = delete;
+    pairing_priorityqueue& operator=(const pairing_priorityqueue&) = delete;
+
+    pairing_priorityqueue(pairing_priorityqueue&& other) noexcept
+        : root(other.root), size(other.size), nextSeq(other.nextSeq),
+          pool(std::move(other.pool)), comp(std::move(other.comp)) {
+        other.root = nullptr;
+        other.size = 0;
+        other.nextSeq = 0;
+    }
+
+    pairing_priorityqueue& operator=(pairing_priorityqueue&& other) noexcept {
+        if (this != &other) {
+            clear();
+            swap(other);
+        }
+        return *this;
+    }
+
+    //
+    // swap:
+    //
+    // Exchanges the contents of two queues, whose allocators must compare
+    // equal unless they propagate on swap.
+    // O(1)
+    //
+    void swap(pairing_priorityqueue& other) noexcept {
+        pool.swap(other.pool);
+        std::swap(root, other.root);
+        std::swap(size, other.size);
+        std::swap(nextSeq, other.nextSeq);
+        std::swap(comp, other.comp);
+    }
+
+    friend void swap(pairing_priorityqueue& a, pairing_priorityqueue& b) noexcept {
+        a.swap(b);
+    }
+
+    ~pairing_priorityqueue() {
+        clear();
+    }
+
+    //
+    // clear:
+    //
+    // Removes every element.  The child/sibling tree is taken apart by
+    // rotating first children up, so no stack is needed.
+    // O(chunks) when T and Priority are trivially destructible, otherwise O(n)
+    //
+    void clear() {
+        if (!is_trivially_destructible<NODE>::value) {
+            NODE* node = root;
+            while (node != nullptr) {
+                if (node->child != nullptr) {
+                    NODE* child = node->child;
+                    node->child = child->sibling;
+                    child->sibling = node;
+                    node = child;
+                }
+                else {
+                    NODE* next = node->sibling;
+                    node->~NODE();
+                    node = next;
+                }
+            }
+        }
+        pool.release();
+        root = nullptr;
+        size = 0;
+        nextSeq = 0;
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority and returns a handle to it
+    // (which may be ignored).  emplace constructs the value in place.
+    // O(1)
+    //
+    handle enqueue(const T& value, const Priority& priority) {
+        return emplace(priority, value);
+    }
+
+    handle enqueue(T&& value, const Priority& priority) {
+        return emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    handle emplace(const Priority& priority, Args&&... args) {
+        NODE* node = createNode(priority, std::forward<Args>(args)...);
+        attach(node);
+        return handle(node);
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  The value is moved, not copied.
+    // Returns T() when empty.
+    // O(logn) amortized
+    //
+    T dequeue() {
+        if (root == nullptr) {
+            return T();
+        }
+        NODE* node = root;
+        T valueOut = std::move(node->value);
+        detach(node);
+        destroyNode(node);
+        return valueOut;
+    }
+
+    //
+    // update_priority:
+    //
+    // Moves the element h refers to to a new priority.  A decrease-key (a
+    // priority that comes first) cuts the element's subtree loose and links
+    // it against the root; anything else takes the element out and puts it
+    // back.  Like a new enqueue, the element becomes the last of the
+    // elements with its new priority.  An equivalent priority leaves the
+    // element where it is.
+    // O(1) for a decrease-key, O(logn) amortized otherwise
+    //
+    void update_priority(handle h, const Priority& priority) {
+        NODE* node = h.node;
+        if (comp(priority, node->priority)) {
+            node->priority = priority;
+            node->seq = nextSeq++;
+            if (node != root) {
+                cut(node);
+                root = link(root, node);
+            }
+        }
+        else if (comp(node->priority, priority)) {
+            detach(node);
+            node->priority = priority;
+            node->seq = nextSeq++;
+            attach(node);
+        }
+    }
+
+    //
+    // erase:
+    //
+    // Removes the element h refers to; h becomes invalid.
+    // O(logn) amortized
+    //
+    void erase(handle h) {
+        detach(h.node);
+        destroyNode(h.node);
+    }
+
+    //
+    // peek:
+    //
+    // returns a reference to the value of the next element in the priority
+    // queue but does not remove the item from the priority queue.
+    // O(1)
+    //
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
+        return root->value;
+    }
+
+    //
+    // try_peek / try_dequeue:
+    //
+    // Same as in priorityqueue: false (or an empty optional) for an empty
+    // queue, without constructing a T.
+    //
+    bool try_peek(T& valueOut) const {
+        if (root == nullptr) {
+            return false;
+        }
+        valueOut = root->value;
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (root == nullptr) {
+            return nullopt;
+        }
+        return root->value;
+    }
+
+    bool try_dequeue(T& valueOut) {
+        if (root == nullptr) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (root == nullptr) {
+            return nullopt;
+        }
+        return dequeue();
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.
+    // O(1)
+    //
+    int Size() const {
+        return size;
+    }
+
+    //
+    // get_allocator:
+    //
+    // Returns a copy of the allocator the nodes are drawn from.
+    //
+    Alloc get_allocator() const {
+        return pool.get_allocator();
+    }
+};
@@ -15,120 +15,1483 @@
 #include <iostream>
 #include <sstream>
 #include <set>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <vector>
+#include <concepts>
+#include <atomic>
 
 using namespace std;
 
-template<typename T>
+//
+// Balancing policies for the custom BST.
+//
+// A policy is told where the shape of the tree changed and restores its own
+// invariant with rotations.  Only nodes that sit in the tree are ever handed
+// to a policy; nodes on a duplicate link list are never rotated, they simply
+// ride along with the head of their list.
+//
+// Besides the two fixups a policy provides join(left, mid, right), which
+// links two trees and a node whose priority lies between them into one tree
+// and returns its root; it is the building block of priorityqueue::split.
+//
+// unbalanced_tree: the original plain BST, no rebalancing at all.
+//
+struct unbalanced_tree {
+    template<typename NODE>
+    static void insertFixup(NODE*& root, NODE* node) {}
+
+    template<typename NODE>
+    static void eraseFixup(NODE*& root, NODE* parent) {}
+
+    // O(1)
+    template<typename NODE>
+    static NODE* join(NODE* left, NODE* mid, NODE* right) {
+        mid->parent = nullptr;
+        mid->left = left;
+        mid->right = right;
+        if (left != nullptr) {
+            left->parent = mid;
+        }
+        if (right != nullptr) {
+            right->parent = mid;
+        }
+        return mid;
+    }
+};
+
+//
+// avl_tree: height balanced BST, O(logn) height regardless of the order the
+// priorities arrive in.
+//
+struct avl_tree {
+    template<typename NODE>
+    static int height(NODE* node) {
+        return node == nullptr ? 0 : node->height;
+    }
+
+    template<typename NODE>
+    static void updateHeight(NODE* node) {
+        node->height = 1 + max(height(node->left), height(node->right));
+    }
+
+    // Replaces "from" with "to" in from's parent (or as the root).
+    template<typename NODE>
+    static void replaceChild(NODE*& root, NODE* from, NODE* to) {
+        to->parent = from->parent;
+        if (from->parent == nullptr) {
+            root = to;
+        }
+        else if (from->parent->left == from) {
+            from->parent->left = to;
+        }
+        else {
+            from->parent->right = to;
+        }
+    }
+
+    template<typename NODE>
+    static void rotateLeft(NODE*& root, NODE* node) {
+        NODE* pivot = node->right;
+        replaceChild(root, node, pivot);
+        node->right = pivot->left;
+        if (node->right != nullptr) {
+            node->right->parent = node;
+        }
+        pivot->left = node;
+        node->parent = pivot;
+        updateHeight(node);
+        updateHeight(pivot);
+    }
+
+    template<typename NODE>
+    static void rotateRight(NODE*& root, NODE* node) {
+        NODE* pivot = node->left;
+        replaceChild(root, node, pivot);
+        node->left = pivot->right;
+        if (node->left != nullptr) {
+            node->left->parent = node;
+        }
+        pivot->right = node;
+        node->parent = pivot;
+        updateHeight(node);
+        updateHeight(pivot);
+    }
+
+    // Restores the AVL property at node and returns the root of the
+    // (possibly rotated) subtree.
+    template<typename NODE>
+    static NODE* rebalance(NODE*& root, NODE* node) {
+        updateHeight(node);
+        int balance = height(node->left) - height(node->right);
+        if (balance > 1) {
+            if (height(node->left->left) < height(node->left->right)) {
+                rotateLeft(root, node->left);
+            }
+            rotateRight(root, node);
+            return node->parent;
+        }
+        if (balance < -1) {
+            if (height(node->right->right) < height(node->right->left)) {
+                rotateRight(root, node->right);
+            }
+            rotateLeft(root, node);
+            return node->parent;
+        }
+        return node;
+    }
+
+    // Rebalances from curr towards the root, stopping as soon as a subtree
+    // keeps its old height.
+    template<typename NODE>
+    static void retrace(NODE*& root, NODE* curr) {
+        while (curr != nullptr) {
+            int before = curr->height;
+            curr = rebalance(root, curr);
+            if (curr->height == before) {
+                break;
+            }
+            curr = curr->parent;
+        }
+    }
+
+    // Walks from the parent of a freshly linked leaf towards the root.
+    template<typename NODE>
+    static void insertFixup(NODE*& root, NODE* node) {
+        retrace(root, node->parent);
+    }
+
+    // Walks from the parent of a removed node towards the root.
+    template<typename NODE>
+    static void eraseFixup(NODE*& root, NODE* parent) {
+        retrace(root, parent);
+    }
+
+    // Hangs mid, with left and right as its subtrees, from the spine of the
+    // higher tree where the spine is about as high as the lower tree, then
+    // rebalances upwards like an insertion.
+    // O(|height(left) - height(right)| + 1)
+    template<typename NODE>
+    static NODE* join(NODE* left, NODE* mid, NODE* right) {
+        if (left != nullptr) {
+            left->parent = nullptr;
+        }
+        if (right != nullptr) {
+            right->parent = nullptr;
+        }
+        int leftHeight = height(left);
+        int rightHeight = height(right);
+        NODE* root;
+        NODE* above = nullptr;
+        if (leftHeight > rightHeight + 1) {
+            root = left;
+            while (height(left) > rightHeight + 1) {
+                above = left;
+                left = left->right;
+            }
+            above->right = mid;
+        }
+        else if (rightHeight > leftHeight + 1) {
+            root = right;
+            while (height(right) > leftHeight + 1) {
+                above = right;
+                right = right->left;
+            }
+            above->left = mid;
+        }
+        else {
+            root = mid;
+        }
+        mid->parent = above;
+        mid->left = left;
+        mid->right = right;
+        if (left != nullptr) {
+            left->parent = mid;
+        }
+        if (right != nullptr) {
+            right->parent = mid;
+        }
+        updateHeight(mid);
+        retrace(root, above);
+        return root;
+    }
+};
+
+//
+// nodepool<NODE, Alloc>
+//
+// Slab allocator for the nodes of a priorityqueue.  Memory is requested from
+// Alloc (any std::allocator compatible type, including the pmr allocators)
+// in cache line aligned chunks that grow geometrically, and handed out one
+// node at a time.  deallocate() pushes the node onto an intrusive free list
+// that the next allocate() pops from, so a steady enqueue/dequeue workload
+// never touches Alloc.  release() gives every chunk back in O(chunks); it does
+// not run any destructors, that is the owner's job.
+//
+// The chunks a pool carves nodes from form its arena, and every node slot
+// records the arena it came from.  Nodes may move to another queue without
+// being reallocated (see priorityqueue::split and merge).  A pool that frees
+// a node of another arena pushes it onto that arena's remote list, where the
+// owning pool picks it up for reuse.  Once its owner lets go of an arena
+// (release, or merge into another queue), the arena counts its nodes still
+// in use and goes back to Alloc with the last of them.  So an arena outlives
+// its pool only as long as some queue still holds one of its nodes, but
+// until then its free nodes are not reused: after split/merge round trips a
+// queue may keep several partly used arenas alive.
+//
+template<typename NODE, typename Alloc>
+class nodepool {
+private:
+    struct alignas(64) LINE {
+        unsigned char bytes[64];
+    };
+    struct CHUNK {
+        CHUNK* next;  // next chunk in the owned list
+        size_t lines;  // # of cache lines in this chunk, header included
+    };
+    struct ARENA;
+    struct SLOT {
+        ARENA* arena;  // arena the slot was carved from
+        alignas(NODE) unsigned char node[sizeof(NODE)];  // the node, or the next free SLOT
+    };
+    using LineAlloc = typename allocator_traits<Alloc>::template rebind_alloc<LINE>;
+    using LineTraits = allocator_traits<LineAlloc>;
+
+    // Lives in the header of the first chunk of an arena; the other chunks
+    // are linked after it through first.next.
+    struct ARENA {
+        CHUNK first;  // header of the chunk holding this record
+        atomic<SLOT*> remote;  // slots freed by other pools, DETACHED once the owner let go
+        atomic<ptrdiff_t> outstanding;  // after the owner let go: # of nodes still in use
+        LineAlloc alloc;  // gives the chunks back
+
+        ARENA(size_t lines, const LineAlloc& alloc)
+            : first{nullptr, lines}, remote(nullptr), outstanding(0), alloc(alloc) {
+        }
+    };
+
+    static_assert(alignof(SLOT) <= alignof(LINE), "node alignment exceeds a cache line");
+
+    static constexpr size_t HEADER_LINES = (sizeof(ARENA) + sizeof(LINE) - 1) / sizeof(LINE);
+    static constexpr size_t FIRST_CHUNK_NODES = 32;
+    static constexpr size_t MAX_CHUNK_NODES = 8192;
+
+    LineAlloc alloc;  // source of chunk memory
+    ARENA* arena;  // chunks new nodes are carved from, nullptr until the first one
+    SLOT* freeList;  // slots of arena handed back through deallocate
+    unsigned char* bump;  // next never used slot in the newest chunk
+    unsigned char* bumpEnd;  // end of the newest chunk
+    size_t nextChunkNodes;  // capacity of the next chunk to allocate
+    size_t live;  // # of slots of arena handed out and not given back to this pool
+    bool shared;  // nodes may have moved between this pool and another one
+
+    static SLOT* detached() {
+        return reinterpret_cast<SLOT*>(alignof(SLOT));
+    }
+
+    static SLOT* slotOf(void* memory) {
+        return reinterpret_cast<SLOT*>(static_cast<unsigned char*>(memory) - offsetof(SLOT, node));
+    }
+
+    static SLOT*& nextFree(SLOT* slot) {
+        return *reinterpret_cast<SLOT**>(slot->node);
+    }
+
+    void addChunk(size_t nodes) {
+        size_t lines = HEADER_LINES + (nodes * sizeof(SLOT) + sizeof(LINE) - 1) / sizeof(LINE);
+        LINE* first = std::to_address(LineTraits::allocate(alloc, lines));
+        if (arena == nullptr) {
+            arena = ::new (static_cast<void*>(first)) ARENA(lines, alloc);
+        }
+        else {
+            CHUNK* chunk = reinterpret_cast<CHUNK*>(first);
+            chunk->next = arena->first.next;
+            chunk->lines = lines;
+            arena->first.next = chunk;
+        }
+        bump = reinterpret_cast<unsigned char*>(first + HEADER_LINES);
+        bumpEnd = bump + nodes * sizeof(SLOT);
+    }
+
+    static void freeChunk(LineAlloc& alloc, CHUNK* chunk) {
+        LINE* first = reinterpret_cast<LINE*>(chunk);
+        LineTraits::deallocate(alloc,
+            pointer_traits<typename LineTraits::pointer>::pointer_to(*first),
+            chunk->lines);
+    }
+
+    // Gives every chunk of arena back to its allocator.
+    static void freeArena(ARENA* arena) {
+        LineAlloc alloc(arena->alloc);
+        CHUNK first = arena->first;
+        arena->~ARENA();
+        while (first.next != nullptr) {
+            CHUNK* next = first.next->next;
+            freeChunk(alloc, first.next);
+            first.next = next;
+        }
+        CHUNK* header = ::new (static_cast<void*>(arena)) CHUNK(first);
+        freeChunk(alloc, header);
+    }
+
+    // Hands a slot of another pool's arena back to it: onto its remote list
+    // while the owner holds the arena, otherwise off its outstanding count,
+    // freeing the arena with the last one.
+    static void giveBack(SLOT* slot) {
+        ARENA* owner = slot->arena;
+        SLOT* head = owner->remote.load(memory_order_relaxed);
+        while (true) {
+            if (head == detached()) {
+                if (owner->outstanding.fetch_sub(1, memory_order_acq_rel) == 1) {
+                    freeArena(owner);
+                }
+                return;
+            }
+            nextFree(slot) = head;
+            if (owner->remote.compare_exchange_weak(head, slot, memory_order_release,
+                                                    memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    // Lets go of arena, whose slots that are still in use may live on in
+    // other queues: the arena is freed now if none are, otherwise by the
+    // pool that gives the last one back.
+    void detach() {
+        SLOT* returned = arena->remote.exchange(detached(), memory_order_acq_rel);
+        ptrdiff_t inUse = (ptrdiff_t)live;
+        for (; returned != nullptr; returned = nextFree(returned)) {
+            inUse--;
+        }
+        if (arena->outstanding.fetch_add(inUse, memory_order_acq_rel) + inUse == 0) {
+            freeArena(arena);
+        }
+        arena = nullptr;
+        freeList = nullptr;
+        bump = nullptr;
+        bumpEnd = nullptr;
+        nextChunkNodes = FIRST_CHUNK_NODES;
+        live = 0;
+    }
+
+public:
+    explicit nodepool(const Alloc& alloc = Alloc())
+        : alloc(alloc), arena(nullptr), freeList(nullptr), bump(nullptr), bumpEnd(nullptr),
+          nextChunkNodes(FIRST_CHUNK_NODES), live(0), shared(false) {
+    }
+
+    nodepool(const nodepool&) = delete;
+    nodepool& operator=(const nodepool&) = delete;
+
+    nodepool(nodepool&& other) noexcept
+        : alloc(std::move(other.alloc)), arena(other.arena), freeList(other.freeList),
+          bump(other.bump), bumpEnd(other.bumpEnd), nextChunkNodes(other.nextChunkNodes),
+          live(other.live), shared(other.shared) {
+        other.arena = nullptr;
+        other.freeList = nullptr;
+        other.bump = nullptr;
+        other.bumpEnd = nullptr;
+        other.nextChunkNodes = FIRST_CHUNK_NODES;
+        other.live = 0;
+        other.shared = false;
+    }
+
+    nodepool& operator=(nodepool&& other) noexcept {
+        if (this != &other) {
+            release();
+            alloc = std::move(other.alloc);
+            swapState(other);
+        }
+        return *this;
+    }
+
+    //
+    // swap:
+    //
+    // Exchanges the chunks and free lists of two pools.  The allocators are
+    // exchanged only if the allocator type propagates on swap, otherwise they
+    // must compare equal.
+    // O(1)
+    //
+    void swap(nodepool& other) noexcept {
+        if constexpr (LineTraits::propagate_on_container_swap::value) {
+            std::swap(alloc, other.alloc);
+        }
+        swapState(other);
+    }
+
+    ~nodepool() {
+        release();
+    }
+
+    Alloc get_allocator() const {
+        return Alloc(alloc);
+    }
+
+    //
+    // allocate:
+    //
+    // Returns raw, suitably aligned memory for one NODE.
+    // O(1) amortized
+    //
+    void* allocate() {
+        if (freeList == nullptr && arena != nullptr &&
+            arena->remote.load(memory_order_relaxed) != nullptr) {
+            // Reuse what other pools gave back; those slots were counted live.
+            freeList = arena->remote.exchange(nullptr, memory_order_acquire);
+            for (SLOT* slot = freeList; slot != nullptr; slot = nextFree(slot)) {
+                live--;
+            }
+        }
+        SLOT* slot;
+        if (freeList != nullptr) {
+            slot = freeList;
+            freeList = nextFree(slot);
+        }
+        else {
+            if (bump == bumpEnd) {
+                addChunk(nextChunkNodes);
+                nextChunkNodes = min(nextChunkNodes * 2, MAX_CHUNK_NODES);
+            }
+            slot = reinterpret_cast<SLOT*>(bump);
+            slot->arena = arena;
+            bump += sizeof(SLOT);
+        }
+        live++;
+        return slot->node;
+    }
+
+    //
+    // reserve:
+    //
+    // Makes sure the next n allocate() calls that are not served from the
+    // free list come from one contiguous chunk.
+    // O(1)
+    //
+    void reserve(size_t n) {
+        if ((size_t)(bumpEnd - bump) < n * sizeof(SLOT)) {
+            addChunk(n);
+        }
+    }
+
+    //
+    // deallocate:
+    //
+    // Hands a node's memory back for reuse; the node must already be
+    // destroyed.  A node of another pool's arena goes back to that arena.
+    // O(1)
+    //
+    void deallocate(void* memory) {
+        SLOT* slot = slotOf(memory);
+        if (slot->arena != arena) {
+            giveBack(slot);
+            return;
+        }
+        nextFree(slot) = freeList;
+        freeList = slot;
+        live--;
+    }
+
+    //
+    // absorb:
+    //
+    // Takes over the nodes of other, whose allocator must compare equal, so
+    // its queue's nodes can move into this pool's queue as they are; other
+    // ends up empty.  An empty pool takes other's arena over whole;
+    // otherwise other lets go of its arena, which is freed once the nodes
+    // that moved here are.
+    // O(1), plus the slots other pools gave back to other
+    //
+    void absorb(nodepool& other) {
+        if (arena == nullptr) {
+            bool wasShared = shared;
+            swapState(other);
+            shared = shared || wasShared;
+            return;
+        }
+        if (other.arena != nullptr) {
+            other.detach();
+        }
+        shared = true;
+        other.shared = false;
+    }
+
+    //
+    // share:
+    //
+    // Lets nodes that owner, whose allocator must compare equal, allocated
+    // be handed to this pool's queue as they are.  Either pool gives such a
+    // node back to the arena it came from when it is deallocated.
+    // O(1)
+    //
+    void share(nodepool& owner) {
+        shared = true;
+        owner.shared = true;
+    }
+
+    //
+    // exclusive:
+    //
+    // Returns true if no node ever moved between this pool and another one,
+    // so release() may drop the nodes without deallocating them one by one.
+    // O(1)
+    //
+    bool exclusive() const {
+        return !shared;
+    }
+
+    //
+    // release:
+    //
+    // Returns every chunk to the allocator.  Any node still in use becomes
+    // invalid, except for nodes that moved to another pool's queue, which
+    // keep their arena alive (see above).  Unless the pool is exclusive,
+    // every node of its own queue must have been deallocated first.
+    // O(chunks), plus the slots other pools gave back
+    //
+    void release() {
+        if (arena != nullptr) {
+            if (shared) {
+                detach();
+            }
+            else {
+                freeArena(arena);
+            }
+        }
+        arena = nullptr;
+        freeList = nullptr;
+        bump = nullptr;
+        bumpEnd = nullptr;
+        nextChunkNodes = FIRST_CHUNK_NODES;
+        live = 0;
+        shared = false;
+    }
+
+private:
+    void swapState(nodepool& other) noexcept {
+        std::swap(arena, other.arena);
+        std::swap(freeList, other.freeList);
+        std::swap(bump, other.bump);
+        std::swap(bumpEnd, other.bumpEnd);
+        std::swap(nextChunkNodes, other.nextChunkNodes);
+        std::swap(live, other.live);
+        std::swap(shared, other.shared);
+    }
+};
+
+//
+// entry_ref<First, Second>
+//
+// What the queues' const_iterators dereference to: a pair of references
+// (or of a priority and a reference) to an element in place.  The iterators'
+// value_type is the plain pair it converts to, and the basic_common_reference
+// below tells the standard iterator concepts how the two meet, which pair
+// itself only does from C++23 on.
+//
+template<typename First, typename Second>
+struct entry_ref : pair<First, Second> {
+    using pair<First, Second>::pair;
+};
+
+template<typename First, typename Second, typename U1, typename U2,
+         template<typename> class TQual, template<typename> class UQual>
+struct std::basic_common_reference<entry_ref<First, Second>, pair<U1, U2>, TQual, UQual> {
+    using type = pair<U1, U2>;
+};
+
+template<typename First, typename Second, typename U1, typename U2,
+         template<typename> class TQual, template<typename> class UQual>
+struct std::basic_common_reference<pair<U1, U2>, entry_ref<First, Second>, TQual, UQual> {
+    using type = pair<U1, U2>;
+};
+
+//
+// priorityqueue<T, Priority, Compare, Balance, Alloc>
+//
+// Priority is the key type, ordered by Compare; the element whose priority
+// comes first under Compare is dequeued first.  The defaults, int and
+// std::less<int>, give the original min-queue on int priorities.  Use
+// std::greater<> for a max-queue, or any strict weak order for composite
+// keys.  Priorities that are equivalent under Compare share a duplicate list.
+//
+// Balance picks the tree balancing policy.  The default, unbalanced_tree,
+// keeps the original BST shape (and therefore the shape based operator==);
+// avl_tree guarantees O(logn) enqueue/dequeue/peek for any input order.
+//
+// Alloc supplies the memory for the nodes, which are carved out of it by a
+// nodepool (see above).  Any std::allocator compatible type works, e.g.
+// std::pmr::polymorphic_allocator<T> to draw from a memory_resource.
+//
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>,
+         typename Balance = unbalanced_tree, typename Alloc = std::allocator<T>>
 class priorityqueue {
 private:
     struct NODE {
-        int priority;  // used to build BST
+        Priority priority;  // used to build BST
         T value;  // stored data for the p-queue
         bool dup;  // marked true when there are duplicate priorities
+        int height;  // subtree height, maintained by the balancing policy
         NODE* parent;  // links back to parent
         NODE* link;  // links to linked list of NODES with duplicate priorities
+        NODE* tail;  // last NODE of the duplicate list, kept on the list head
+        int count;  // # of NODES in the duplicate list, kept on the list head
         NODE* left;  // links to left child
         NODE* right;  // links to right child
     };
     NODE* root;  // pointer to root node of the BST
+    NODE* minHead;  // list head with the minimum priority (cached, see minNode)
     int size;  // # of elements in the pqueue
-    NODE* curr;  // pointer to next item in pqueue (see begin and next)
+    NODE* curr;  // pointer to next item in pqueue (see rewind and next)
+    nodepool<NODE, Alloc> pool;  // storage for every NODE
+    [[no_unique_address]] Compare comp;  // orders the priorities
+
+    // Constructs the value in place from args inside a pooled node.
+    template<typename... Args>
+    NODE* createNode(const Priority& priority, Args&&... args) {
+        void* memory = pool.allocate();
+        NODE* createdNode;
+        try {
+            createdNode = ::new (memory) NODE{priority, T(std::forward<Args>(args)...)};
+        }
+        catch (...) {
+            pool.deallocate(memory);
+            throw;
+        }
+        createdNode->parent = nullptr;
+        createdNode->dup = false;
+        createdNode->height = 1;
+        createdNode->link = nullptr;
+        createdNode->tail = createdNode;
+        createdNode->count = 1;
+        createdNode->left = nullptr;
+        createdNode->right = nullptr;
+        return createdNode;
+    }
+
+    void destroyNode(NODE* node) {
+        node->~NODE();
+        pool.deallocate(node);
+    }
+
+    // Returns the list head with the minimum priority, or nullptr for an
+    // empty tree.  The node is cached in minHead, which linkNode, unlinkMin
+    // and every function that rebuilds the tree keep up to date.
+    // O(1)
+    NODE* minNode() const {
+        return minHead;
+    }
+
+    // This function inserts a new node into the binary search tree based on its priority.
+    // If a node with the same priority already exists, the new node is added to the end of its link list
+    // in O(1) through the tail pointer of the list head.
+    void linkNode(NODE* newNode) {
+        linkList(newNode);
+        size++;
+    }
+
+    // Same as linkNode for a whole link list headed by head (a single fresh
+    // node is a list of one).  The list is spliced in as a unit, either as a
+    // new tree node or after the tail of the list with the same priority.
+    // Does not update size.
+    void linkList(NODE* head) {
+        const Priority& priority = head->priority;
+        NODE* current = root;
+        NODE* prev = nullptr;
+        bool isDuplicate = false;
+
+        // Find the correct location to insert the new node
+        while (current != nullptr) {
+            prev = current;
+            if (comp(priority, current->priority)) {
+                current = current->left;
+            }
+            else if (comp(current->priority, priority)) {
+                current = current->right;
+            }
+            else {
+                isDuplicate = true;
+                break;
+            }
+        }
+        // If a node with the same priority already exists, append the list
+        // after the tail of its link list (this also sets its dup flag).
+        if (isDuplicate) {
+            appendList(current, head);
+        }
+        // Otherwise, insert the list head into the binary search tree.
+        else {
+            head->parent = prev;
+            head->left = nullptr;
+            head->right = nullptr;
+            head->height = 1;
+
+            if (prev == nullptr) {
+                root = head;
+            }
+            else if (comp(priority, prev->priority)) {
+                prev->left = head;
+            }
+            else {
+                prev->right = head;
+            }
+            Balance::insertFixup(root, head);
+            if (minHead == nullptr || comp(priority, minHead->priority)) {
+                minHead = head;
+            }
+        }
+    }
+
+    // Returns the node with the smallest priority in the subtree at node.
+    static NODE* leftmost(NODE* node) {
+        while (node->left != nullptr) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    // Returns the in-order successor of a tree node (not a duplicate list
+    // node), or nullptr for the last one.  Climbs through the parent
+    // pointers, so a full walk costs O(1) amortized per node.
+    static NODE* successor(NODE* node) {
+        if (node->right != nullptr) {
+            return leftmost(node->right);
+        }
+        while (node->parent != nullptr && node->parent->right == node) {
+            node = node->parent;
+        }
+        return node->parent;
+    }
+
+    // In-order traversal without recursion: leftmost node first, then
+    // successor by successor, printing each duplicate list in order.
+    void inTraversal(NODE* root, ostream& ss) {
+        // if the root is null, return immediately
+        if (root == nullptr) {
+            return;
+        }
+        for (NODE* node = leftmost(root); node != nullptr; node = successor(node)) {
+            // print the node and, if it has duplicates, the rest of its list
+            for (NODE* tmpNode = node; tmpNode != nullptr; tmpNode = tmpNode->link) {
+                ss << tmpNode->priority << " value: " << tmpNode->value << endl;
+            }
+        }
+    }
+
+    // Post-order traversal of the binary search tree, running the destructor
+    // of every node.  The memory itself goes back with pool.release(), or
+    // node by node when the pool shares nodes with other pools, so that
+    // nodes of another arena return to it.
+    // Iterative: descends to a leaf, destroys it together with its link
+    // list, detaches it from its parent and continues from the parent.
+    void postTraversal(NODE* root) {
+        NODE* node = root;
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                node = node->left;
+            }
+            else if (node->right != nullptr) {
+                node = node->right;
+            }
+            else {
+                NODE* parent = node->parent;
+                if (parent != nullptr) {
+                    if (parent->left == node) {
+                        parent->left = nullptr;
+                    }
+                    else {
+                        parent->right = nullptr;
+                    }
+                }
+                // Destroy the node and the link list
+                bool exclusive = pool.exclusive();
+                while (node != nullptr) {
+                    NODE* next = node->link;
+                    if (exclusive) {
+                        node->~NODE();
+                    }
+                    else {
+                        destroyNode(node);
+                    }
+                    node = next;
+                }
+                node = parent;
+            }
+        }
+    }
+
+    // Compares the values of two link lists, head nodes included.
+    static bool isIdenticalList(NODE* list1, NODE* list2) {
+        while (list1 != nullptr && list2 != nullptr) {
+            if (list1->value != list2->value) {
+                return false;
+            }
+            list1 = list1->link;
+            list2 = list2->link;
+        }
+        return list1 == nullptr && list2 == nullptr;
+    }
+
+    // Walks both trees in lock step without recursion.  "prev" remembers
+    // where the walk came from: from the parent means the node is new, from
+    // the left child means the right subtree is next, from the right child
+    // means the subtree is done.
+    bool isIdentical(NODE* root1, NODE* root2) const {
+        // If one root is null and the other isn't, the trees are not identical.
+        if ((root1 == nullptr) != (root2 == nullptr)) {
+            return false;
+        }
+        NODE* node1 = root1;
+        NODE* node2 = root2;
+        NODE* prev = nullptr;
+        while (node1 != nullptr) {
+            NODE* from = prev;
+            prev = node1;
+            if (from == node1->parent) {
+                // If the values or the shape differ, the trees are not identical.
+                if (!isIdenticalList(node1, node2) ||
+                    (node1->left == nullptr) != (node2->left == nullptr) ||
+                    (node1->right == nullptr) != (node2->right == nullptr)) {
+                    return false;
+                }
+                if (node1->left != nullptr) {
+                    node1 = node1->left;
+                    node2 = node2->left;
+                    continue;
+                }
+            }
+            if (from != node1->right && node1->right != nullptr) {
+                node1 = node1->right;
+                node2 = node2->right;
+                continue;
+            }
+            node1 = node1->parent;
+            node2 = node2->parent;
+        }
+        return true;
+    }
+
+    // Copies a tree node and its whole duplicate list; the copy of the head
+    // is attached below parent.
+    NODE* cloneList(NODE* source, NODE* parent) {
+        NODE* head = createNode(source->priority, source->value);
+        head->parent = parent;
+        head->dup = source->dup;
+        head->height = source->height;
+        head->count = source->count;
+        NODE* last = head;
+        for (NODE* dupNode = source->link; dupNode != nullptr; dupNode = dupNode->link) {
+            last->link = createNode(dupNode->priority, dupNode->value);
+            last->link->parent = last;
+            last = last->link;
+            head->tail = last;
+        }
+        return head;
+    }
+
+    // Detaches curr, which must be the head of the leftmost list (the first
+    // element of the queue), without destroying it, and returns the list
+    // head holding the new first element (nullptr once the queue is empty).
+    NODE* unlinkMin(NODE* curr) {
+        NODE* parent = curr->parent;
+        NODE* nextMin;
+
+        if (curr->dup == false) {
+            // No duplicates, simply remove the node.  Its successor is the
+            // new minimum; rotations below keep that node the same.
+            nextMin = successor(curr);
+            if (curr == root) {
+                root = curr->right;
+            } else {
+                parent->left = curr->right;
+            }
+            if (curr->right != nullptr) {
+                curr->right->parent = parent;
+            }
+            Balance::eraseFixup(root, parent);
+        } else {
+            // There are duplicates, promote the next node in the link list.
+            // The promoted node takes over curr's place in the tree, so the
+            // shape (and therefore the balance) is unchanged.  A list node's
+            // own child pointers may be stale (it can have been a tree node
+            // before merge or update_priority appended it), so both are set.
+            NODE* next = curr->link;
+            next->dup = curr->link->link != nullptr;
+            next->parent = parent;
+            next->left = nullptr;
+            next->right = curr->right;
+            next->height = curr->height;
+            next->tail = curr->tail;
+            next->count = curr->count - 1;
+            if (next->right != nullptr) {
+                next->right->parent = next;
+            }
+            if (curr == root) {
+                root = next;
+            } else {
+                parent->left = next;
+            }
+            nextMin = next;
+        }
+
+        minHead = nextMin;
+        size--;
+        return nextMin;
+    }
+
+    // Returns the list head whose priority is equivalent to priority, or
+    // nullptr if there is none.
+    NODE* findHead(const Priority& priority) const {
+        NODE* current = root;
+        while (current != nullptr) {
+            if (comp(priority, current->priority)) {
+                current = current->left;
+            }
+            else if (comp(current->priority, priority)) {
+                current = current->right;
+            }
+            else {
+                return current;
+            }
+        }
+        return nullptr;
+    }
+
+    // Puts "to" (possibly nullptr) where "from" hangs in the tree.
+    void replaceInTree(NODE* from, NODE* to) {
+        if (to != nullptr) {
+            to->parent = from->parent;
+        }
+        if (from->parent == nullptr) {
+            root = to;
+        }
+        else if (from->parent->left == from) {
+            from->parent->left = to;
+        }
+        else {
+            from->parent->right = to;
+        }
+    }
+
+    // Detaches any element, without destroying it: a duplicate is cut out of
+    // its link list, a list head hands its place in the tree to the next
+    // duplicate, and a lone tree node is removed from the BST (replaced by
+    // its in-order successor when it has two children).
+    // O(logn), where n is number of unique nodes in tree
+    void unlinkNode(NODE* node) {
+        if (node == minHead) {
+            unlinkMin(node);
+            return;
+        }
+        if (node->parent != nullptr && node->parent->link == node) {
+            NODE* head = findHead(node->priority);
+            NODE* prev = node->parent;
+            prev->link = node->link;
+            if (node->link != nullptr) {
+                node->link->parent = prev;
+            }
+            if (head->tail == node) {
+                head->tail = prev;
+            }
+            head->count--;
+            head->dup = head->link != nullptr;
+        }
+        else if (node->dup) {
+            NODE* next = node->link;
+            next->dup = next->link != nullptr;
+            next->tail = node->tail;
+            next->count = node->count - 1;
+            next->height = node->height;
+            next->left = node->left;
+            next->right = node->right;
+            if (next->left != nullptr) {
+                next->left->parent = next;
+            }
+            if (next->right != nullptr) {
+                next->right->parent = next;
+            }
+            replaceInTree(node, next);
+        }
+        else {
+            NODE* fixup;
+            if (node->left == nullptr || node->right == nullptr) {
+                fixup = node->parent;
+                replaceInTree(node, node->left != nullptr ? node->left : node->right);
+            }
+            else {
+                NODE* next = leftmost(node->right);
+                if (next->parent != node) {
+                    fixup = next->parent;
+                    next->parent->left = next->right;
+                    if (next->right != nullptr) {
+                        next->right->parent = next->parent;
+                    }
+                    next->right = node->right;
+                    next->right->parent = next;
+                }
+                else {
+                    fixup = next;
+                }
+                next->left = node->left;
+                next->left->parent = next;
+                next->height = node->height;
+                replaceInTree(node, next);
+            }
+            Balance::eraseFixup(root, fixup);
+        }
+        size--;
+    }
+
+    // Appends the link list headed by list to the end of head's list.
+    // O(1) through the tail pointers
+    static void appendList(NODE* head, NODE* list) {
+        head->tail->link = list;
+        list->parent = head->tail;
+        head->tail = list->tail;
+        head->count += list->count;
+        head->dup = true;
+    }
+
+    // Collects the tree nodes (list heads) in priority order.
+    void collectHeads(vector<NODE*>& heads) const {
+        if (root == nullptr) {
+            return;
+        }
+        for (NODE* node = leftmost(root); node != nullptr; node = successor(node)) {
+            heads.push_back(node);
+        }
+    }
+
+    // Links heads[first..last) into a perfectly balanced subtree below
+    // parent and returns its root.  The recursion only goes O(logn) deep.
+    static NODE* buildBalanced(vector<NODE*>& heads, size_t first, size_t last, NODE* parent) {
+        if (first == last) {
+            return nullptr;
+        }
+        size_t middle = first + (last - first) / 2;
+        NODE* node = heads[middle];
+        node->parent = parent;
+        node->left = buildBalanced(heads, first, middle, node);
+        node->right = buildBalanced(heads, middle + 1, last, node);
+        int leftHeight = node->left == nullptr ? 0 : node->left->height;
+        int rightHeight = node->right == nullptr ? 0 : node->right->height;
+        node->height = 1 + max(leftHeight, rightHeight);
+        return node;
+    }
+
+    // Replaces the tree with a perfectly balanced one over heads, which must
+    // be sorted by priority with no two equivalent.  A perfectly balanced
+    // tree is also a valid AVL tree.
+    // O(n), where n is number of unique nodes in tree
+    void rebuild(vector<NODE*>& heads) {
+        root = buildBalanced(heads, 0, heads.size(), nullptr);
+        minHead = root == nullptr ? nullptr : leftmost(root);
+        curr = nullptr;
+    }
+
+    // Turns the freshly created nodes, in arrival order, into sorted list
+    // heads: equivalent priorities are chained in arrival order.  Input that
+    // is already sorted is detected and grouped in one pass; anything else is
+    // stable sorted first.
+    void groupSorted(vector<NODE*>& nodes, vector<NODE*>& heads) {
+        bool sorted = true;
+        for (size_t i = 1; i < nodes.size() && sorted; i++) {
+            sorted = !comp(nodes[i]->priority, nodes[i - 1]->priority);
+        }
+        if (!sorted) {
+            stable_sort(nodes.begin(), nodes.end(), [this](NODE* a, NODE* b) {
+                return comp(a->priority, b->priority);
+            });
+        }
+        for (NODE* node : nodes) {
+            if (!heads.empty() && !comp(heads.back()->priority, node->priority)) {
+                appendList(heads.back(), node);
+            }
+            else {
+                heads.push_back(node);
+            }
+        }
+    }
+
+    // Merges two sorted head sequences; equivalent priorities are joined
+    // into one list with the nodes of "older" first.
+    void mergeHeads(vector<NODE*>& older, vector<NODE*>& newer, vector<NODE*>& merged) {
+        merged.reserve(older.size() + newer.size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < older.size() && j < newer.size()) {
+            if (comp(older[i]->priority, newer[j]->priority)) {
+                merged.push_back(older[i++]);
+            }
+            else if (comp(newer[j]->priority, older[i]->priority)) {
+                merged.push_back(newer[j++]);
+            }
+            else {
+                appendList(older[i], newer[j++]);
+                merged.push_back(older[i++]);
+            }
+        }
+        merged.insert(merged.end(), older.begin() + i, older.end());
+        merged.insert(merged.end(), newer.begin() + j, newer.end());
+    }
+
+    // Adds freshly created nodes, in arrival order, to the queue: a handful
+    // next to a much larger queue are linked one by one, otherwise they are
+    // grouped, merged with the existing list heads and the tree is rebuilt.
+    void insertNodes(vector<NODE*>& nodes) {
+        if (nodes.empty()) {
+            return;
+        }
+        if (nodes.size() < (size_t)size / 16) {
+            for (NODE* node : nodes) {
+                linkNode(node);
+            }
+            return;
+        }
+        vector<NODE*> newHeads;
+        groupSorted(nodes, newHeads);
+        vector<NODE*> oldHeads;
+        collectHeads(oldHeads);
+        if (oldHeads.empty()) {
+            rebuild(newHeads);
+        }
+        else {
+            vector<NODE*> merged;
+            mergeHeads(oldHeads, newHeads, merged);
+            rebuild(merged);
+        }
+        size += (int)nodes.size();
+    }
+
+    // Rebuilds the shape of other's tree node for node into this (empty)
+    // queue.  The walk is iterative: it moves through both trees in lock
+    // step, descending into a child when its copy does not exist yet and
+    // climbing through the parent pointers otherwise.  All the nodes come
+    // from one contiguous chunk of the pool.
+    void copyFrom(const priorityqueue& other) {
+        if (other.root == nullptr) {
+            return;
+        }
+        pool.reserve(other.size);
+        try {
+            root = cloneList(other.root, nullptr);
+            NODE* from = other.root;
+            NODE* to = root;
+            while (from != nullptr) {
+                if (from->left != nullptr && to->left == nullptr) {
+                    to->left = cloneList(from->left, to);
+                    from = from->left;
+                    to = to->left;
+                }
+                else if (from->right != nullptr && to->right == nullptr) {
+                    to->right = cloneList(from->right, to);
+                    from = from->right;
+                    to = to->right;
+                }
+                else {
+                    from = from->parent;
+                    to = to->parent;
+                }
+            }
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+        minHead = leftmost(root);
+        size = other.size;
+    }
+
+public:
+    //
+    // default constructor:
+    //
+    // Creates an empty priority queue.
+    // O(1)
+    //
+    priorityqueue() {
+        root = nullptr;
+        minHead = nullptr;
+        size = 0;
+        curr = root;
+    }
+
+    //
+    // allocator constructor:
+    //
+    // Creates an empty priority queue whose nodes come from alloc.
+    // O(1)
+    //
+    explicit priorityqueue(const Alloc& alloc) : pool(alloc) {
+        root = nullptr;
+        minHead = nullptr;
+        size = 0;
+        curr = root;
+    }
+
+    //
+    // comparator constructor:
+    //
+    // Creates an empty priority queue ordered by comp.
+    // O(1)
+    //
+    explicit priorityqueue(const Compare& comp, const Alloc& alloc = Alloc())
+        : pool(alloc), comp(comp) {
+        root = nullptr;
+        minHead = nullptr;
+        size = 0;
+        curr = root;
+    }
+    
+    //
+    // copy constructor:
+    //
+    // Makes a copy of the "other" tree with exactly the same shape.
+    // O(n), where n is total number of nodes in custom BST
+    //
+    priorityqueue(const priorityqueue& other)
+        : pool(allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator())),
+          comp(other.comp) {
+        root = nullptr;
+        minHead = nullptr;
+        size = 0;
+        curr = nullptr;
+        copyFrom(other);
+    }
 
-    NODE* createNode(T value, int priority) {
-        NODE* createdNode = new NODE();
-        createdNode->priority = priority;
-        createdNode->value = value;
-        createdNode->parent = nullptr;
-        createdNode->dup = false;
-        createdNode->link = nullptr;
-        createdNode->left = nullptr;
-        createdNode->right = nullptr;
-        return createdNode;
+    //
+    // move constructor:
+    //
+    // Takes over the nodes of "other", leaving it empty.
+    // O(1)
+    //
+    priorityqueue(priorityqueue&& other) noexcept
+        : pool(std::move(other.pool)), comp(std::move(other.comp)) {
+        root = other.root;
+        minHead = other.minHead;
+        size = other.size;
+        curr = other.curr;
+        other.root = nullptr;
+        other.minHead = nullptr;
+        other.size = 0;
+        other.curr = nullptr;
     }
 
-    void inTraversal(NODE* root, ostream& ss) {
-        // if the root is null, return immediately
-        if (root == nullptr) {
-            return;
-        }
-        // recursively visit the left subtree
-        inTraversal(root->left, ss);
-        // if the current node has duplicates, iterate through the linked list
-        // and print each node's priority and value
-        if (root->dup) {
-            NODE* tmpNode = root;
-            while (tmpNode != nullptr) {
-                ss << tmpNode->priority << " value: " << tmpNode->value << endl;
-                tmpNode = tmpNode->link;
-            }
-        }
-        // otherwise, print the current node's priority and value
-        else {
-            ss << root->priority << " value: " << root->value << endl;
-        }
-        // recursively visit the right subtree
-        inTraversal(root->right, ss);
+    //
+    // range constructor:
+    //
+    // Creates a priority queue holding the (priority, value) pairs in
+    // [first, last), e.g. another queue's iterators or a vector of pairs.
+    // Elements with equivalent priorities keep their order in the range.
+    // See enqueue_bulk for the cost.
+    //
+    template<typename InputIt>
+        requires input_iterator<InputIt>
+    priorityqueue(InputIt first, InputIt last, const Compare& comp = Compare(),
+                  const Alloc& alloc = Alloc())
+        : pool(alloc), comp(comp) {
+        root = nullptr;
+        minHead = nullptr;
+        size = 0;
+        curr = root;
+        enqueue_bulk(first, last);
     }
 
-    // Post-order traversal of the binary search tree
-    void postTraversal(NODE* root) {
-        if (root == nullptr) {
-            return;
-        }
-        // Traverse the left subtree
-        postTraversal(root->left);
-        // Traverse the right subtree
-        postTraversal(root->right);
-        // Traverse the link list
-        postTraversal(root->link);
-        // Delete the root node
-        delete root;
+    //
+    // assign:
+    //
+    // Replaces the contents with the (priority, value) pairs in [first, last).
+    //
+    template<typename InputIt>
+        requires input_iterator<InputIt>
+    void assign(InputIt first, InputIt last) {
+        clear();
+        enqueue_bulk(first, last);
     }
 
-    bool isIdentical(NODE* root1, NODE* root2) const {
-        // If both roots are null, the trees are identical.
-        if (root1 == nullptr && root2 == nullptr) {
-            return true;
+    //
+    // enqueue_bulk:
+    //
+    // Enqueues every (priority, value) pair in [first, last) as if by
+    // enqueue, in range order, but builds the tree in one go: the new nodes
+    // come from one contiguous allocation (for forward iterators), are
+    // grouped by priority, merged with the existing elements and linked into
+    // a perfectly balanced tree.  A handful of elements added to a much
+    // larger queue are linked one by one instead.
+    // O(n + k) when the range is sorted by priority, O(n + k logk) otherwise,
+    // where n is the current size and k the length of the range
+    //
+    template<typename InputIt>
+        requires input_iterator<InputIt>
+    void enqueue_bulk(InputIt first, InputIt last) {
+        vector<NODE*> nodes;
+        if constexpr (forward_iterator<InputIt>) {
+            size_t count = (size_t)distance(first, last);
+            nodes.reserve(count);
+            pool.reserve(count);
         }
-        // If one root is null and the other isn't, the trees are not identical.
-        if (root1 == nullptr && root2 != nullptr) {
-            return false;
+        try {
+            for (; first != last; ++first) {
+                auto&& entry = *first;
+                nodes.push_back(createNode(entry.first, std::forward<decltype(entry)>(entry).second));
+            }
         }
-        // If the values of the nodes differ, the trees are not identical.
-        if (root1->value != root2->value) {
-            return false;
+        catch (...) {
+            for (NODE* node : nodes) {
+                destroyNode(node);
+            }
+            throw;
         }
-        // Recursively check the left subtree, right subtree, and link list of both roots.
-        return isIdentical(root1->left, root2->left) &&
-            isIdentical(root1->right, root2->right) &&
-            isIdentical(root1->link, root2->link);
+        insertNodes(nodes);
     }
 
-    void preTraverse(NODE* node) {
-        if (node == nullptr) {
+    //
+    // merge:
+    //
+    // Moves every element of "other" into this queue, leaving other empty.
+    // The nodes themselves are spliced over, whole duplicate lists at a
+    // time, and other's pool chunks stay alive until the last of them is
+    // freed (see nodepool), so no payload is copied or moved and no node is
+    // allocated.  On equal priorities this
+    // queue's elements stay ahead of other's.  A much smaller other is
+    // linked in list by list; otherwise both trees are flattened, merged and
+    // rebuilt perfectly balanced.  If the allocators compare unequal (e.g.
+    // pmr queues on different resources) the nodes cannot change owner, and
+    // the payloads are moved into new nodes instead; handles to other's
+    // elements are then invalidated.  The new nodes are all built before
+    // other is cleared, so if that throws both queues are left unchanged,
+    // unless T has only a move constructor that may throw, in which case
+    // elements already moved out of other are left moved-from.
+    // O(n + m), or O(k logn) for k distinct priorities in a small other
+    //
+    void merge(priorityqueue&& other) {
+        if (this == &other || other.root == nullptr) {
+            return;
+        }
+        if (!(get_allocator() == other.get_allocator())) {
+            vector<NODE*> nodes;
+            nodes.reserve(other.size);
+            pool.reserve(other.size);
+            try {
+                for (NODE* head = other.minHead; head != nullptr; head = successor(head)) {
+                    for (NODE* node = head; node != nullptr; node = node->link) {
+                        nodes.push_back(createNode(node->priority, std::move_if_noexcept(node->value)));
+                    }
+                }
+            }
+            catch (...) {
+                for (NODE* node : nodes) {
+                    destroyNode(node);
+                }
+                throw;
+            }
+            other.clear();
+            insertNodes(nodes);
             return;
         }
-        enqueue(node->value, node->priority);
-        preTraverse(node->left);
-        preTraverse(node->right);
-        preTraverse(node->link);
-    }
 
+        vector<NODE*> otherHeads;
+        other.collectHeads(otherHeads);
+        int count = other.size;
+        pool.absorb(other.pool);
+        other.root = nullptr;
+        other.minHead = nullptr;
+        other.size = 0;
+        other.curr = nullptr;
 
+        if ((size_t)count < (size_t)size / 16) {
+            for (NODE* head : otherHeads) {
+                linkList(head);
+            }
+        }
+        else {
+            vector<NODE*> heads;
+            collectHeads(heads);
+            vector<NODE*> merged;
+            mergeHeads(heads, otherHeads, merged);
+            rebuild(merged);
+        }
+        size += count;
+    }
 
-public:
     //
-    // default constructor:
+    // split:
     //
-    // Creates an empty priority queue.
-    // O(1)
+    // Moves every element whose priority comes after the given priority
+    // (with the default std::less: every priority > the given one) into a
+    // new queue and returns it; this queue keeps the rest.  The tree is cut
+    // along the search path for priority and the pieces on either side are
+    // joined back together by the balancing policy, so duplicate lists
+    // change queue as units and no node off that path is touched.  Nothing
+    // is copied or moved: the new queue holds nodes of this queue's pool (see
+    // nodepool::share), which keep their chunks alive until they are freed,
+    // so repeated split/merge round trips can keep memory alive after most
+    // of it is no longer in use.  Equal priorities keep their order in both
+    // queues.
+    // O(logn) with avl_tree (O(h) unbalanced) for the tree, plus O(min(a, b))
+    // to count the elements on either side, where a and b are the numbers of
+    // unique priorities that stay and that move
     //
-    priorityqueue() {
-        root = nullptr;
-        size = 0;
-        curr = root;
+    priorityqueue split(const Priority& priority) {
+        priorityqueue upper(comp, get_allocator());
+        if (root == nullptr) {
+            return upper;
+        }
+        upper.pool.share(pool);
+
+        // Find the bottom of the search path for priority.
+        NODE* node = root;
+        NODE* last = nullptr;
+        while (node != nullptr) {
+            last = node;
+            node = comp(priority, node->priority) ? node->left : node->right;
+        }
+
+        // Climb back up the path: each node joins the lower or the upper tree
+        // together with its subtree on the far side of the path.
+        NODE* lowerRoot = nullptr;
+        NODE* upperRoot = nullptr;
+        for (node = last; node != nullptr;) {
+            NODE* parent = node->parent;
+            if (comp(priority, node->priority)) {
+                upperRoot = Balance::join(upperRoot, node, node->right);
+            }
+            else {
+                lowerRoot = Balance::join(node->left, node, lowerRoot);
+            }
+            node = parent;
+        }
+        root = lowerRoot;
+        if (root == nullptr) {
+            minHead = nullptr;
+        }
+        curr = nullptr;
+        upper.root = upperRoot;
+        upper.minHead = upperRoot == nullptr ? nullptr : leftmost(upperRoot);
+
+        // Count the smaller side: walk both in lock step until one ends.
+        int lowerSize = 0;
+        int upperSize = 0;
+        NODE* lowerHead = minHead;
+        NODE* upperHead = upper.minHead;
+        while (lowerHead != nullptr && upperHead != nullptr) {
+            lowerSize += lowerHead->count;
+            upperSize += upperHead->count;
+            lowerHead = successor(lowerHead);
+            upperHead = successor(upperHead);
+        }
+        upper.size = lowerHead == nullptr ? size - lowerSize : upperSize;
+        size -= upper.size;
+        return upper;
     }
-    
+
     //
     // operator=
     //
@@ -137,22 +1500,91 @@ public:
     // O(n), where n is total number of nodes in custom BST
     //
     priorityqueue& operator=(const priorityqueue& other) {
+        if (this != &other) {
+            this->clear();
+            comp = other.comp;
+            copyFrom(other);
+            curr = nullptr;
+        }
+        return *this;
+    }
+
+    //
+    // move operator=
+    //
+    // Frees "this" tree and takes over the nodes of "other", leaving it
+    // empty.  When the allocators differ and do not propagate, the elements
+    // are copied instead.
+    // O(1), O(n) for unequal allocators
+    //
+    priorityqueue& operator=(priorityqueue&& other) noexcept(
+        allocator_traits<Alloc>::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
         this->clear();
-        preTraverse(other.root);
-        this->size = other.size;
+        if (allocator_traits<Alloc>::propagate_on_container_move_assignment::value ||
+            get_allocator() == other.get_allocator()) {
+            if constexpr (allocator_traits<Alloc>::propagate_on_container_move_assignment::value) {
+                pool = std::move(other.pool);
+            }
+            else {
+                pool.swap(other.pool);
+            }
+            comp = std::move(other.comp);
+            root = other.root;
+            minHead = other.minHead;
+            size = other.size;
+            curr = other.curr;
+            other.root = nullptr;
+            other.minHead = nullptr;
+            other.size = 0;
+            other.curr = nullptr;
+        }
+        else {
+            comp = other.comp;
+            copyFrom(other);
+            curr = nullptr;
+            other.clear();
+        }
         return *this;
     }
+
+    //
+    // swap:
+    //
+    // Exchanges the contents of two queues.
+    // O(1)
+    //
+    void swap(priorityqueue& other) noexcept {
+        pool.swap(other.pool);
+        std::swap(root, other.root);
+        std::swap(minHead, other.minHead);
+        std::swap(size, other.size);
+        std::swap(curr, other.curr);
+        std::swap(comp, other.comp);
+    }
+
+    friend void swap(priorityqueue& a, priorityqueue& b) noexcept {
+        a.swap(b);
+    }
     
     //
     // clear:
     //
     // Frees the memory associated with the priority queue but is public.
-    // O(n), where n is total number of nodes in custom BST
+    // O(chunks) when T and Priority are trivially destructible and no node
+    // moved in or out through split or merge, otherwise O(n) destructor
+    // calls, where n is total number of nodes in custom BST
     //
     void clear() {
-        postTraversal(root);
+        if (!is_trivially_destructible<NODE>::value || !pool.exclusive()) {
+            postTraversal(root);
+        }
+        pool.release();
         size = 0;
         root = NULL;
+        minHead = nullptr;
     }
     
     //
@@ -166,120 +1598,184 @@ public:
     }
     
     //
-    // enqueue:
+    // handle
     //
-    // Inserts the value into the custom BST in the correct location based on
-    // priority.
-    // O(logn + m), where n is number of unique nodes in tree and m is number 
-    // of duplicate priorities
+    // Refers to one element of the queue, as returned by enqueue and
+    // emplace, for update_priority and erase.  A handle stays valid until
+    // its element is dequeued or erased (or the queue is cleared or
+    // destroyed); it follows the element through merge, split, swap and
+    // move.  The exception is a merge or move assignment between queues
+    // whose allocators compare unequal (and do not propagate): the elements
+    // are then rebuilt in new nodes and handles into the source queue are
+    // invalidated.  A default constructed handle refers to nothing.
     //
-    // This function inserts a new node with the given value and priority into the binary search tree.
-    // If a node with the same priority already exists, the new node is added to the end of its link list.
-    void enqueue(T value, int priority) {
-        NODE* current = root;
-        NODE* prev = nullptr;
-        bool isDuplicate = false;
+    class handle {
+    public:
+        handle() : node(nullptr) {
+        }
 
-        // Find the correct location to insert the new node
-        while (current != nullptr) {
-            prev = current;
-            if (current->priority > priority) {
-                current = current->left;
-            }
-            else if (current->priority < priority) {
-                current = current->right;
-            }
-            else {
-                isDuplicate = true;
-                current->dup = isDuplicate; // Set the duplicate flag of the existing node to true.
-                break;
-            }
+        const Priority& priority() const {
+            return node->priority;
         }
-        // If a node with the same priority already exists, add the new node to its link list.
-        if (isDuplicate) {
-            NODE* lastNode = current;
-            while (lastNode->link != nullptr) {
-                lastNode = lastNode->link;
-            }
-            lastNode->link = createNode(value, priority);
-            lastNode->link->parent = lastNode;
+
+        const T& value() const {
+            return node->value;
         }
-        // Otherwise, insert the new node into the binary search tree.
-        else {
-            NODE* newNode = createNode(value, priority);
-            newNode->parent = prev;
 
-            if (prev == nullptr) {
-                root = newNode;
-            }
-            else if (prev->priority > priority) {
-                prev->left = newNode;
-            }
-            else {
-                prev->right = newNode;
-            }
+        bool operator==(const handle& other) const {
+            return node == other.node;
         }
 
-        size++;
+    private:
+        friend class priorityqueue;
+
+        explicit handle(NODE* node) : node(node) {
+        }
+
+        NODE* node;  // the element's node, which never moves in memory
+    };
+
+    //
+    // enqueue:
+    //
+    // Inserts the value into the custom BST in the correct location based on
+    // priority, and returns a handle to the new element (which may be
+    // ignored).  The lvalue overload copies the value once into its node,
+    // the rvalue overload moves it.
+    // O(logn), where n is number of unique nodes in tree (O(h) with the
+    // unbalanced_tree policy, where h degrades to n on sorted input)
+    //
+    handle enqueue(const T& value, const Priority& priority) {
+        NODE* node = createNode(priority, value);
+        linkNode(node);
+        return handle(node);
+    }
+
+    handle enqueue(T&& value, const Priority& priority) {
+        NODE* node = createNode(priority, std::move(value));
+        linkNode(node);
+        return handle(node);
+    }
+
+    //
+    // emplace:
+    //
+    // Like enqueue, but constructs the value in place inside its node from
+    // args, so no temporary T is ever made.
+    // O(logn), where n is number of unique nodes in tree
+    //
+    template<typename... Args>
+    handle emplace(const Priority& priority, Args&&... args) {
+        NODE* node = createNode(priority, std::forward<Args>(args)...);
+        linkNode(node);
+        return handle(node);
     }
 
+    //
+    // update_priority:
+    //
+    // Moves the element h refers to to a new priority (decrease-key or
+    // increase-key).  The element is relinked, not copied: it becomes the
+    // last of the elements with the new priority, and h stays valid.  An
+    // equivalent priority leaves the element where it is.
+    // O(logn), where n is number of unique nodes in tree
+    //
+    void update_priority(handle h, const Priority& priority) {
+        NODE* node = h.node;
+        if (!comp(priority, node->priority) && !comp(node->priority, priority)) {
+            return;
+        }
+        unlinkNode(node);
+        node->priority = priority;
+        node->dup = false;
+        node->link = nullptr;
+        node->tail = node;
+        node->count = 1;
+        linkNode(node);
+    }
 
+    //
+    // erase:
+    //
+    // Removes the element h refers to, wherever it is in the queue; h and
+    // any iterator to the element become invalid.
+    // O(logn), where n is number of unique nodes in tree; O(1) for the
+    // first element of a duplicate list
+    //
+    void erase(handle h) {
+        unlinkNode(h.node);
+        destroyNode(h.node);
+    }
 
     //
     // dequeue:
     //
     // returns the value of the next element in the priority queue and removes
-    // the element from the priority queue.
-    // O(logn + m), where n is number of unique nodes in tree and m is number 
-    // of duplicate priorities
+    // the element from the priority queue.  The value is moved, not copied.
+    // Starts directly at the cached minimum; finding the next one and any
+    // rebalancing is O(logn), where n is number of unique nodes in tree.
+    // Promoting the next duplicate is O(1).
     //
     T dequeue() {
-    if (root == nullptr) {
-        return T();
-    }
+        if (root == nullptr) {
+            return T();
+        }
 
-    NODE* curr = root;
-    NODE* parent = nullptr;
+        // Find the minimum node
+        NODE* curr = minNode();
 
-    // Find the minimum node
-    while (curr->left != nullptr) {
-        parent = curr;
-        curr = curr->left;
+        // Move the payload out; the node is destroyed right after.
+        T valueOut = std::move(curr->value);
+        unlinkMin(curr);
+        destroyNode(curr);
+        return valueOut;
     }
 
-    T valueOut = curr->value;
-
-    if (curr->dup == false) {
-        // No duplicates, simply remove the node
-        if (curr == root) {
-            root = curr->right;
-        } else {
-            parent->left = curr->right;
-        }
-        if (curr->right != nullptr) {
-            curr->right->parent = parent;
-        }
-        delete curr;
-    } else {
-        // There are duplicates, promote the next node in the link list
-        NODE* next = curr->link;
-        next->dup = curr->link->link != nullptr;
-        next->parent = parent;
-        next->right = curr->right;
-        if (next->right != nullptr) {
-            next->right->parent = next;
-        }
-        if (curr == root) {
-            root = next;
-        } else {
-            parent->left = next;
+    //
+    // dequeue_n:
+    //
+    // Removes up to k elements from the front of the priority queue, moving
+    // their values to out in dequeue order, and returns the advanced output
+    // iterator.  The elements are taken in one in-order sweep that starts at
+    // the minimum and steps from list to list, instead of searching for the
+    // minimum again for every element.
+    // O(logn + k) amortized, where n is number of unique nodes in tree
+    //
+    template<typename OutputIt>
+    OutputIt dequeue_n(size_t k, OutputIt out) {
+        NODE* curr = minNode();
+        while (k > 0 && curr != nullptr) {
+            *out = std::move(curr->value);
+            ++out;
+            NODE* next = unlinkMin(curr);
+            destroyNode(curr);
+            curr = next;
+            k--;
         }
-        delete curr;
+        return out;
     }
 
-    size--;
-    return valueOut;
-}
+    //
+    // drain_until:
+    //
+    // Removes every element whose priority does not come after the given
+    // priority (with the default std::less: every priority <= the given
+    // one), moving the values to out in dequeue order.  Returns the advanced
+    // output iterator.  Same sweep as dequeue_n.
+    // O(logn + k) amortized, where k is the number of elements removed
+    //
+    template<typename OutputIt>
+    OutputIt drain_until(const Priority& priority, OutputIt out) {
+        NODE* curr = minNode();
+        while (curr != nullptr && !comp(priority, curr->priority)) {
+            *out = std::move(curr->value);
+            ++out;
+            NODE* next = unlinkMin(curr);
+            destroyNode(curr);
+            curr = next;
+        }
+        return out;
+    }
     
     //
     // Size:
@@ -287,31 +1783,128 @@ public:
     // Returns the # of elements in the priority queue, 0 if empty.
     // O(1)
     //
-    int Size() {
-        return size; // TO DO: update this return
+    int Size() const {
+        return size;
     }
     
     //
-    // begin
+    // const_iterator
+    //
+    // Forward iterator over the queue in priority order, duplicates in the
+    // order they were enqueued (the same order as toString).  Dereferencing
+    // yields a (priority, const T&) pair that refers to the element in place;
+    // value_type is a plain (priority, T) pair, so algorithms that copy
+    // elements out get copies rather than references.  Iterators do not
+    // touch the queue, so any number of them can be used at once, including
+    // through a const reference.  An iterator stays valid until its element
+    // is dequeued.
+    // O(1) amortized per increment
+    //
+    class const_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using iterator_concept = forward_iterator_tag;
+        using value_type = pair<Priority, T>;
+        using reference = entry_ref<const Priority&, const T&>;
+        using difference_type = ptrdiff_t;
+
+        // Holds the reference pair so that it->first and it->second work.
+        struct pointer {
+            reference entry;
+
+            const reference* operator->() const {
+                return &entry;
+            }
+        };
+
+        const_iterator() : head(nullptr), node(nullptr) {
+        }
+
+        reference operator*() const {
+            return reference(node->priority, node->value);
+        }
+
+        pointer operator->() const {
+            return pointer{**this};
+        }
+
+        const_iterator& operator++() {
+            // Walk the duplicate list first, then move on to the next tree node.
+            if (node->link != nullptr) {
+                node = node->link;
+            }
+            else {
+                head = successor(head);
+                node = head;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator before = *this;
+            ++*this;
+            return before;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return node == other.node;
+        }
+
+    private:
+        friend class priorityqueue;
+
+        explicit const_iterator(NODE* first) : head(first), node(first) {
+        }
+
+        NODE* head;  // tree node whose duplicate list is being walked
+        NODE* node;  // current element: head or one of its duplicates
+    };
+
+    //
+    // begin / end, cbegin / cend:
+    //
+    // Iterators to the first element and one past the last one, so the queue
+    // works with range-for and the standard algorithms:
+    //    for (auto [priority, value] : pq) {
+    //      cout << priority << " value: " << value << endl;
+    //    }
+    // O(1)
+    //
+    const_iterator begin() const {
+        return const_iterator(minNode());
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    //
+    // rewind
     //
     // Resets internal state for an inTraversal traversal.  After the
-    // call to begin(), the internal state denotes the first inTraversal
+    // call to rewind(), the internal state denotes the first inTraversal
     // node; this ensure that first call to next() function returns
-    // the first inTraversal node value.
+    // the first inTraversal node value.  begin() leaves this state alone,
+    // so iterating never disturbs a traversal with next().
     //
-    // O(logn), where n is number of unique nodes in tree
+    // O(1)
     //
     // Example usage:
-    //    pq.begin();
-    //    while (tree.next(value, priority)) {
+    //    pq.rewind();
+    //    while (pq.next(value, priority)) {
     //      cout << priority << " value: " << value << endl;
     //    }
     //    cout << priority << " value: " << value << endl;
-    void begin() {
-        curr = root;
-        while (curr->left != nullptr) {
-            curr = curr->left;
-        }
+    void rewind() {
+        curr = minNode();
     }
     
     //
@@ -329,13 +1922,13 @@ public:
     // O(logn), where n is the number of unique nodes in tree
     //
     // Example usage:
-    //    pq.begin();
+    //    pq.rewind();
     //    while (pq.next(value, priority)) {
     //      cout << priority << " value: " << value << endl;
     //    }
     //    cout << priority << " value: " << value << endl;
     //
-    bool next(T& value, int& priority) {
+    bool next(T& value, Priority& priority) {
         // If current node is null, return false.
         if (curr == nullptr) {
             return false;
@@ -351,8 +1944,8 @@ public:
             return true;
         }
 
-        // Traverse up the tree until a node is found that has a right subtree or the root is reached.
-        while (curr->parent != nullptr && curr->priority == curr->parent->priority) {
+        // Walk back up the link list to its head; a list node is always its parent's link.
+        while (curr->parent != nullptr && curr->parent->link == curr) {
             curr = curr->parent;
         }
 
@@ -396,20 +1989,62 @@ public:
     //
     // peek:
     //
-    // returns the value of the next element in the priority queue but does not
-    // remove the item from the priority queue.
-    // O(logn + m), where n is number of unique nodes in tree and m is number 
-    // of duplicate priorities
+    // returns a reference to the value of the next element in the priority
+    // queue but does not remove the item from the priority queue.  The
+    // reference stays valid until that element is dequeued.
+    // O(1), the minimum is cached
     //
-    T peek() {
-        // Start at the root and follow the leftmost path to find the node with the
-        // minimum priority.
-        NODE* curr = root;
-        while (curr->left != nullptr) {
-            curr = curr->left;
-        }
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
         // Return the value of the node with minimum priority.
-        return curr->value;
+        return minNode()->value;
+    }
+
+    //
+    // try_peek:
+    //
+    // Copies the value of the next element into valueOut and returns true, or
+    // returns false without touching valueOut when the queue is empty.  The
+    // optional form returns an empty optional instead; neither constructs a
+    // T for an empty queue.
+    // O(1)
+    //
+    bool try_peek(T& valueOut) const {
+        if (root == nullptr) {
+            return false;
+        }
+        valueOut = minNode()->value;
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (root == nullptr) {
+            return nullopt;
+        }
+        return minNode()->value;
+    }
+
+    //
+    // try_dequeue:
+    //
+    // Removes the next element and moves it into valueOut (or the returned
+    // optional).  Returns false (an empty optional) when the queue is empty.
+    // O(logn), where n is number of unique nodes in tree
+    //
+    bool try_dequeue(T& valueOut) {
+        if (root == nullptr) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (root == nullptr) {
+            return nullopt;
+        }
+        return dequeue();
     }
 
     
@@ -429,6 +2064,15 @@ public:
         }
     }
     
+    //
+    // get_allocator:
+    //
+    // Returns a copy of the allocator the nodes are drawn from.
+    //
+    Alloc get_allocator() const {
+        return pool.get_allocator();
+    }
+
     //
     // getRoot - Do not edit/change!
     //
@@ -439,3 +2083,12 @@ public:
         return root;
     }
 };
+
+//
+// avl_priorityqueue<T, Priority, Compare, Alloc>
+//
+// Shorthand for a priorityqueue using the avl_tree balancing policy.
+//
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>,
+         typename Alloc = std::allocator<T>>
+using avl_priorityqueue = priorityqueue<T, Priority, Compare, avl_tree, Alloc>;
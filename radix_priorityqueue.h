@@ -0,0 +1,270 @@
+//  @file radix_priorityqueue.h
+//  @brief Monotone radix heap with the same enqueue/dequeue/peek/Size
+//  interface as priorityqueue, for integer priorities that never go below
+//  the last one dequeued.
+//  @description Timer queues and Dijkstra only ever enqueue priorities at or
+//  after the last dequeued one.  A radix heap exploits that: an element sits
+//  in bucket b, where b is the index of the highest bit in which its
+//  priority differs from the last dequeued priority (bucket 0 holds the
+//  elements equal to it).  Dequeue empties the lowest non-empty bucket into
+//  the buckets below it, relative to that bucket's minimum.  Every element
+//  only ever moves to lower buckets, so enqueue plus dequeue cost O(log C)
+//  amortized, where C is the largest difference between two priorities in
+//  the queue, and the buckets are plain arrays instead of pointer trees.
+//  Elements are moved between buckets in order, which keeps the same FIFO
+//  order among equal priorities that the custom BST gives through its
+//  duplicate link lists.
+
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template<typename T, typename Priority = int>
+    requires integral<Priority>
+class radix_priorityqueue {
+private:
+    using KEY = make_unsigned_t<Priority>;
+    static constexpr int BITS = numeric_limits<KEY>::digits;
+    static_assert(BITS <= 64, "priorities wider than 64 bits are not supported");
+    static constexpr size_t COMPACT_MIN = 64;  // dequeued entries worth moving the rest for
+
+    struct ENTRY {
+        KEY key;  // priority, mapped to an unsigned key of the same order
+        T value;  // stored data for the p-queue
+    };
+    // buckets[0] holds the elements whose key equals last, buckets[b] those
+    // whose key first differs from last in bit b - 1.  Only dequeue()
+    // redistributes, so last never passes a priority that may still be
+    // enqueued; peek() finds the minimum of the lowest bucket in place and
+    // remembers where it is.
+    vector<ENTRY> buckets[BITS + 1];
+    size_t front;  // index of the first element of buckets[0] still queued
+    KEY last;  // key of the last dequeued element
+    unsigned long long nonEmpty;  // bit b - 1 set if buckets[b] is not empty
+    int size;  // # of elements in the pqueue
+    mutable int peekBucket;  // bucket of the next element found by peek(), -1 if none
+    mutable size_t peekIndex;  // its index in that bucket
+
+    static KEY toKey(Priority priority) {
+        KEY key = (KEY)priority;
+        if constexpr (is_signed_v<Priority>) {
+            key ^= KEY(1) << (BITS - 1);
+        }
+        return key;
+    }
+
+    int bucketOf(KEY key) const {
+        return bit_width((KEY)(key ^ last));
+    }
+
+    // Appends entry to its bucket and returns the bucket.
+    int push(ENTRY&& entry) {
+        int b = bucketOf(entry.key);
+        buckets[b].push_back(std::move(entry));
+        if (b > 0) {
+            nonEmpty |= 1ULL << (b - 1);
+        }
+        return b;
+    }
+
+    // Makes sure buckets[0] holds the next element: empties the lowest
+    // non-empty bucket into the lower ones, relative to its minimum key.
+    // Must not be called on an empty queue.
+    void settle() {
+        if (front < buckets[0].size()) {
+            return;
+        }
+        buckets[0].clear();
+        front = 0;
+        peekBucket = -1;
+        int b = countr_zero(nonEmpty) + 1;
+        vector<ENTRY>& from = buckets[b];
+        KEY smallest = from[0].key;
+        for (const ENTRY& entry : from) {
+            smallest = min(smallest, entry.key);
+        }
+        last = smallest;
+        nonEmpty &= ~(1ULL << (b - 1));
+        for (ENTRY& entry : from) {
+            push(std::move(entry));
+        }
+        from.clear();
+    }
+
+    // Drops the dequeued entries at the start of buckets[0] once they are
+    // all of it or at least half of it, so enqueueing at the last dequeued
+    // priority cannot grow it forever.  A compaction moves fewer entries
+    // than were dequeued since the previous one.
+    // O(1) amortized
+    void compact() {
+        vector<ENTRY>& bucket = buckets[0];
+        if (front == bucket.size()) {
+            bucket.clear();
+            front = 0;
+        }
+        else if (front >= COMPACT_MIN && 2 * front >= bucket.size()) {
+            bucket.erase(bucket.begin(), bucket.begin() + front);
+            front = 0;
+        }
+    }
+
+public:
+    //
+    // default constructor:
+    //
+    // Creates an empty priority queue.
+    // O(1)
+    //
+    radix_priorityqueue() : front(0), last(0), nonEmpty(0), size(0), peekBucket(-1), peekIndex(0) {
+    }
+
+    //
+    // clear:
+    //
+    // Removes every element, keeping the bucket storage for reuse, and lifts
+    // the lower bound on priorities.
+    // O(n) destructor calls
+    //
+    void clear() {
+        for (vector<ENTRY>& bucket : buckets) {
+            bucket.clear();
+        }
+        front = 0;
+        last = 0;
+        nonEmpty = 0;
+        size = 0;
+        peekBucket = -1;
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority, which must not come before
+    // the priority of the last dequeued element; debug builds assert this.
+    // O(1)
+    //
+    void enqueue(const T& value, Priority priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, Priority priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(Priority priority, Args&&... args) {
+        KEY key = toKey(priority);
+        assert(key >= last && "radix_priorityqueue: priority below the last dequeued one");
+        int b = push(ENTRY{key, T(std::forward<Args>(args)...)});
+        if (peekBucket >= 0 && key < buckets[peekBucket][peekIndex].key) {
+            peekBucket = b;
+            peekIndex = buckets[b].size() - 1;
+        }
+        size++;
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  Returns T() when empty.
+    // O(log C) amortized
+    //
+    T dequeue() {
+        if (size == 0) {
+            return T();
+        }
+        settle();
+        T valueOut = std::move(buckets[0][front].value);
+        front++;
+        size--;
+        compact();
+        return valueOut;
+    }
+
+    //
+    // peek:
+    //
+    // returns a reference to the value of the next element in the priority
+    // queue but does not remove the item from the priority queue.  The
+    // reference stays valid until the next enqueue or dequeue.  Unlike
+    // dequeue, peek does not raise the lower bound on priorities.
+    // O(log C) amortized: the lowest bucket is searched at most once per
+    // dequeue
+    //
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
+        if (front < buckets[0].size()) {
+            return buckets[0][front].value;
+        }
+        if (peekBucket < 0) {
+            int b = countr_zero(nonEmpty) + 1;
+            const vector<ENTRY>& bucket = buckets[b];
+            size_t smallest = 0;
+            for (size_t i = 1; i < bucket.size(); i++) {
+                if (bucket[i].key < bucket[smallest].key) {
+                    smallest = i;
+                }
+            }
+            peekBucket = b;
+            peekIndex = smallest;
+        }
+        return buckets[peekBucket][peekIndex].value;
+    }
+
+    //
+    // try_peek / try_dequeue:
+    //
+    // Same as in priorityqueue: false (or an empty optional) for an empty
+    // queue, without constructing a T.
+    //
+    bool try_peek(T& valueOut) const {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = peek();
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (size == 0) {
+            return nullopt;
+        }
+        return peek();
+    }
+
+    bool try_dequeue(T& valueOut) {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (size == 0) {
+            return nullopt;
+        }
+        return dequeue();
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.
+    // O(1)
+    //
+    int Size() const {
+        return size;
+    }
+};
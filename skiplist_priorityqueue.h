@@ -0,0 +1,514 @@
+//  @file skiplist_priorityqueue.h
+//  @brief Lock-free skiplist priority queue with the same enqueue/dequeue/
+//  peek/Size interface as concurrent_priorityqueue.
+//  @description The Lindén-Jonsson skiplist queue.  Elements are ordered by
+//  (priority, sequence number), the sequence number being drawn at enqueue,
+//  so elements with equal priorities come out in the order they were
+//  enqueued, the same order the custom BST's duplicate link lists give.
+//  Enqueue is a lock-free skiplist insert.  Dequeue walks the bottom level
+//  from the head and claims the first node whose incoming bottom pointer it
+//  manages to mark with one fetch_or, so deleted nodes always form a prefix
+//  of the list.  That prefix is not unlinked node by node: once a dequeue
+//  had to step over more than BOUND_OFFSET deleted nodes it swings the
+//  head past all of them with a single CAS, which keeps consumers from
+//  fighting over the same few pointers.  Nodes cut off that way are handed
+//  to an epoch based reclaimer and freed once no operation that could
+//  still see them is running, so a long lived queue does not leak.
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>>
+class skiplist_priorityqueue {
+private:
+    static constexpr int LEVELS = 32;  // tallest tower, enough for 2^32 elements
+    static constexpr int BOUND_OFFSET = 32;  // deleted prefix length that triggers a cut
+    static constexpr int MAX_THREADS = 128;  // operations that can run at once
+    static constexpr int RETIRE_SCAN = 64;  // retirements between epoch advance attempts
+    static constexpr unsigned long long INACTIVE = ~0ULL;
+
+    // A node is followed in memory by its height next pointers.  Bit 0 of
+    // a bottom level next pointer marks the node it points to as deleted;
+    // the upper levels are never marked.  The head and tail sentinels have
+    // no priority or value.
+    struct NODE {
+        union {
+            Priority priority;  // heap key, with seq
+        };
+        union {
+            T value;  // stored data for the p-queue
+        };
+        unsigned long long seq;  // enqueue order, breaks priority ties
+        int height;  // # of next pointers
+        atomic<bool> inserting;  // upper levels still being linked
+
+        explicit NODE(int height) : seq(0), height(height), inserting(false) {
+        }
+
+        ~NODE() {
+        }
+    };
+
+    // Per operation state of the epoch based reclaimer.  An operation owns
+    // one record while it runs and announces the global epoch in it; the
+    // epoch only advances when every running operation has announced the
+    // current one.  A node retired in epoch e is therefore unreachable for
+    // everybody once the epoch reaches e + 2.
+    struct alignas(64) RECORD {
+        atomic<bool> busy{false};  // owned by a running operation
+        atomic<unsigned long long> epoch{INACTIVE};  // announced epoch
+        vector<NODE*> limbo[3];  // retired nodes, by epoch % 3
+        unsigned long long limboEpoch[3] = {0, 0, 0};  // latest epoch retired into each
+        int retired = 0;  // retirements since the last advance attempt
+    };
+
+    // Owns a record for the duration of one operation.
+    struct GUARD {
+        explicit GUARD(const skiplist_priorityqueue& queue) : queue(queue), record(queue.enter()) {
+        }
+
+        ~GUARD() {
+            queue.leave(record);
+        }
+
+        const skiplist_priorityqueue& queue;
+        RECORD* record;  // owned until the operation ends
+    };
+
+    NODE* head;  // sentinel before every node, LEVELS high
+    NODE* tail;  // sentinel after every node
+    atomic<unsigned long long> nextSeq;  // sequence number for the next enqueue
+    atomic<int> size;  // # of elements, a snapshot under concurrent updates
+    atomic<unsigned long long> globalEpoch;  // current reclamation epoch
+    mutable RECORD records[MAX_THREADS];  // one per running operation
+    [[no_unique_address]] Compare comp;  // orders the priorities
+
+    static atomic<uintptr_t>* links(NODE* node) {
+        return reinterpret_cast<atomic<uintptr_t>*>(node + 1);
+    }
+
+    static bool marked(uintptr_t link) {
+        return (link & 1) != 0;
+    }
+
+    static NODE* pointer(uintptr_t link) {
+        return reinterpret_cast<NODE*>(link & ~(uintptr_t)1);
+    }
+
+    static uintptr_t link(NODE* node) {
+        return reinterpret_cast<uintptr_t>(node);
+    }
+
+    // Geometric tower height, p = 1/2, from a per-thread xorshift generator.
+    static int randomHeight() {
+        thread_local unsigned long long state =
+            hash<thread::id>()(this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return countr_zero(state | (1ULL << (LEVELS - 1))) + 1;
+    }
+
+    static NODE* allocateNode(int height) {
+        void* memory = ::operator new(sizeof(NODE) + height * sizeof(atomic<uintptr_t>));
+        NODE* node = ::new (memory) NODE(height);
+        for (int i = 0; i < height; i++) {
+            ::new (&links(node)[i]) atomic<uintptr_t>(0);
+        }
+        return node;
+    }
+
+    static void freeNode(NODE* node) {
+        node->~NODE();
+        ::operator delete(node);
+    }
+
+    static void destroyNode(NODE* node) {
+        node->value.~T();
+        node->priority.~Priority();
+        freeNode(node);
+    }
+
+    // Does node come before the key (priority, seq)?
+    bool before(NODE* node, const Priority& priority, unsigned long long seq) const {
+        if (comp(node->priority, priority)) {
+            return true;
+        }
+        if (comp(priority, node->priority)) {
+            return false;
+        }
+        return node->seq < seq;
+    }
+
+    //
+    // Epoch based reclamation.
+    //
+
+    RECORD* enter() const {
+        thread_local unsigned hint = (unsigned)hash<thread::id>()(this_thread::get_id());
+        for (unsigned i = hint;; i++) {
+            RECORD& record = records[i % MAX_THREADS];
+            bool idle = false;
+            if (!record.busy.load(memory_order_relaxed) &&
+                record.busy.compare_exchange_strong(idle, true, memory_order_acquire)) {
+                hint = i % MAX_THREADS;
+                unsigned long long epoch;
+                do {
+                    epoch = globalEpoch.load();
+                    record.epoch.store(epoch);
+                } while (globalEpoch.load() != epoch);
+                reclaim(record, epoch);
+                return &record;
+            }
+            if (i - hint == MAX_THREADS - 1) {
+                this_thread::yield();
+                i = hint - 1;
+            }
+        }
+    }
+
+    void leave(RECORD* record) const {
+        record->epoch.store(INACTIVE, memory_order_release);
+        record->busy.store(false, memory_order_release);
+    }
+
+    // Frees the record's retired nodes that nobody can reach any more.
+    static void reclaim(RECORD& record, unsigned long long epoch) {
+        for (int k = 0; k < 3; k++) {
+            if (!record.limbo[k].empty() && record.limboEpoch[k] + 2 <= epoch) {
+                for (NODE* node : record.limbo[k]) {
+                    destroyNode(node);
+                }
+                record.limbo[k].clear();
+            }
+        }
+    }
+
+    void retire(RECORD& record, NODE* node) {
+        unsigned long long epoch = globalEpoch.load();
+        record.limbo[epoch % 3].push_back(node);
+        record.limboEpoch[epoch % 3] = epoch;
+        if (++record.retired >= RETIRE_SCAN) {
+            record.retired = 0;
+            tryAdvance();
+        }
+    }
+
+    void tryAdvance() {
+        unsigned long long epoch = globalEpoch.load();
+        for (RECORD& record : records) {
+            unsigned long long announced = record.epoch.load();
+            if (announced != INACTIVE && announced != epoch) {
+                return;
+            }
+        }
+        globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    //
+    // The skiplist.
+    //
+
+    // Fills preds and succs with the nodes around the key on every level,
+    // stepping over deleted nodes, and returns the last deleted node seen
+    // on the bottom level.
+    NODE* locatePreds(const Priority& priority, unsigned long long seq, NODE** preds, NODE** succs) {
+        NODE* x = head;
+        NODE* del = nullptr;
+        int i = LEVELS - 1;
+        while (i >= 0) {
+            // The mark and the pointer come from one load: an insert after x
+            // followed by a claim must not pair a new mark with an old next.
+            uintptr_t raw = links(x)[i].load(memory_order_acquire);
+            NODE* next = pointer(raw);
+            bool deleted = i == 0 && marked(raw);
+            if ((next != tail && before(next, priority, seq)) ||
+                marked(links(next)[0].load(memory_order_acquire)) || deleted) {
+                if (deleted) {
+                    del = next;
+                }
+                x = next;
+            }
+            else {
+                preds[i] = x;
+                succs[i] = next;
+                i--;
+            }
+        }
+        return del;
+    }
+
+    // Moves the head's upper levels past the deleted prefix after a cut.
+    void restructure() {
+        NODE* pred = head;
+        int i = LEVELS - 1;
+        while (i > 0) {
+            uintptr_t first = links(head)[i].load(memory_order_acquire);
+            if (!marked(links(pointer(first))[0].load(memory_order_acquire))) {
+                i--;
+                continue;
+            }
+            NODE* cur = pointer(links(pred)[i].load(memory_order_acquire));
+            while (marked(links(cur)[0].load(memory_order_acquire))) {
+                pred = cur;
+                cur = pointer(links(pred)[i].load(memory_order_acquire));
+            }
+            if (links(head)[i].compare_exchange_strong(first, link(cur), memory_order_acq_rel)) {
+                i--;
+            }
+        }
+    }
+
+    // Claims the first live node and copies its value into valueOut; a
+    // concurrent peek may still be reading it, so it is not moved.
+    bool pop(T& valueOut) {
+        GUARD guard(*this);
+        uintptr_t observed = links(head)[0].load(memory_order_acquire);
+        NODE* newHead = nullptr;
+        NODE* x = head;
+        int offset = 0;
+        while (true) {
+            uintptr_t next = links(x)[0].load(memory_order_acquire);
+            if (pointer(next) == tail) {
+                return false;
+            }
+            if (newHead == nullptr && x->inserting.load(memory_order_acquire)) {
+                newHead = x;
+            }
+            if (!marked(next)) {
+                next = links(x)[0].fetch_or(1, memory_order_acq_rel);
+            }
+            offset++;
+            x = pointer(next);
+            if (!marked(next)) {
+                break;
+            }
+        }
+        valueOut = x->value;
+        size.fetch_sub(1, memory_order_relaxed);
+        if (newHead == nullptr) {
+            newHead = x;
+        }
+        // Cut the deleted prefix off, up to (not past) a node whose upper
+        // levels are still being linked.
+        if (offset <= BOUND_OFFSET || links(head)[0].load(memory_order_acquire) != observed) {
+            return true;
+        }
+        if (links(head)[0].compare_exchange_strong(observed, link(newHead) | 1, memory_order_acq_rel)) {
+            restructure();
+            NODE* cur = pointer(observed);
+            while (cur != newHead) {
+                NODE* next = pointer(links(cur)[0].load(memory_order_acquire));
+                retire(*guard.record, cur);
+                cur = next;
+            }
+        }
+        return true;
+    }
+
+public:
+    //
+    // default / comparator constructors:
+    //
+    // Creates an empty priority queue.
+    // O(MAX_THREADS)
+    //
+    skiplist_priorityqueue() : skiplist_priorityqueue(Compare()) {
+    }
+
+    explicit skiplist_priorityqueue(const Compare& comp)
+        : nextSeq(0), size(0), globalEpoch(0), comp(comp) {
+        head = allocateNode(LEVELS);
+        tail = allocateNode(LEVELS);
+        for (int i = 0; i < LEVELS; i++) {
+            links(head)[i].store(link(tail), memory_order_relaxed);
+        }
+    }
+
+    skiplist_priorityqueue(const skiplist_priorityqueue&) = delete;
+    skiplist_priorityqueue& operator=(const skiplist_priorityqueue&) = delete;
+
+    //
+    // destructor:
+    //
+    // No other thread may be using the queue any more.
+    // O(n)
+    //
+    ~skiplist_priorityqueue() {
+        NODE* node = pointer(links(head)[0].load(memory_order_relaxed));
+        while (node != tail) {
+            NODE* next = pointer(links(node)[0].load(memory_order_relaxed));
+            destroyNode(node);
+            node = next;
+        }
+        for (RECORD& record : records) {
+            reclaim(record, INACTIVE);
+        }
+        freeNode(head);
+        freeNode(tail);
+    }
+
+    //
+    // clear:
+    //
+    // Dequeues every element; safe to call concurrently with the others.
+    // O(nlogn)
+    //
+    void clear() {
+        T value;
+        while (pop(value)) {
+        }
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority, after every element with
+    // an equivalent priority whose enqueue finished before this one began.
+    // O(logn) expected
+    //
+    void enqueue(const T& value, const Priority& priority) {
+        emplace(priority, value);
+    }
+
+    void enqueue(T&& value, const Priority& priority) {
+        emplace(priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(const Priority& priority, Args&&... args) {
+        int height = randomHeight();
+        NODE* node = allocateNode(height);
+        try {
+            ::new (&node->priority) Priority(priority);
+            try {
+                ::new (&node->value) T(std::forward<Args>(args)...);
+            }
+            catch (...) {
+                node->priority.~Priority();
+                throw;
+            }
+        }
+        catch (...) {
+            freeNode(node);
+            throw;
+        }
+        node->seq = nextSeq.fetch_add(1, memory_order_relaxed);
+        node->inserting.store(true, memory_order_relaxed);
+
+        GUARD guard(*this);
+        NODE* preds[LEVELS];
+        NODE* succs[LEVELS];
+        NODE* del;
+        size.fetch_add(1, memory_order_relaxed);
+        while (true) {
+            del = locatePreds(node->priority, node->seq, preds, succs);
+            links(node)[0].store(link(succs[0]), memory_order_relaxed);
+            uintptr_t expected = link(succs[0]);
+            if (links(preds[0])[0].compare_exchange_strong(expected, link(node), memory_order_acq_rel)) {
+                break;
+            }
+        }
+        // The node is in the queue now; the upper levels only speed up
+        // searches, so give up on them once the node or its successor is
+        // being deleted.
+        int i = 1;
+        while (i < height) {
+            links(node)[i].store(link(succs[i]), memory_order_release);
+            if (marked(links(node)[0].load(memory_order_acquire)) ||
+                marked(links(succs[i])[0].load(memory_order_acquire)) || del == succs[i]) {
+                break;
+            }
+            uintptr_t expected = link(succs[i]);
+            if (links(preds[i])[i].compare_exchange_strong(expected, link(node), memory_order_acq_rel)) {
+                i++;
+            }
+            else {
+                del = locatePreds(node->priority, node->seq, preds, succs);
+                if (succs[0] != node) {
+                    break;
+                }
+            }
+        }
+        node->inserting.store(false, memory_order_release);
+    }
+
+    //
+    // dequeue:
+    //
+    // returns the value of the next element in the priority queue and removes
+    // the element from the priority queue.  Returns T() when empty.
+    // O(logn) expected, plus at most BOUND_OFFSET deleted nodes stepped over
+    //
+    T dequeue() {
+        T valueOut{};
+        pop(valueOut);
+        return valueOut;
+    }
+
+    //
+    // try_dequeue:
+    //
+    // Removes the next element and copies it into valueOut (or the returned
+    // optional).  Returns false (an empty optional) when the queue is empty.
+    //
+    bool try_dequeue(T& valueOut) {
+        return pop(valueOut);
+    }
+
+    optional<T> try_dequeue() {
+        T valueOut{};
+        if (!pop(valueOut)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    //
+    // peek / try_peek:
+    //
+    // Returns a copy of the value of the next element, T() (or an empty
+    // optional) when empty.  Another thread may dequeue it right after.
+    //
+    T peek() const {
+        return try_peek().value_or(T());
+    }
+
+    optional<T> try_peek() const {
+        GUARD guard(*this);
+        NODE* x = head;
+        while (true) {
+            uintptr_t next = links(x)[0].load(memory_order_acquire);
+            if (pointer(next) == tail) {
+                return nullopt;
+            }
+            x = pointer(next);
+            if (!marked(next)) {
+                return x->value;
+            }
+        }
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.  Under
+    // concurrent updates this is a snapshot.
+    // O(1)
+    //
+    int Size() const {
+        return size.load(memory_order_relaxed);
+    }
+};
@@ -0,0 +1,262 @@
+//  @file stealing_priorityqueue.h
+//  @brief Per-worker priority queues with work stealing, for schedulers whose
+//  workers mostly consume the jobs they produce.
+//  @description Every worker owns a shard: an avl_priorityqueue behind a
+//  mutex that only its owner ever waits for, plus its size and minimum
+//  priority published in atomics.  Workers enqueue into and dequeue from
+//  their own shard, so in the common case nobody touches anybody else's
+//  cache lines.  A global hint holds the best minimum seen by the last
+//  scan.  A worker only goes stealing when its shard is empty or its own
+//  minimum comes more than slack after the hint, in the comparator's
+//  direction: it then scans the published minima, refreshes the hint, and
+//  takes the front batch of the shard with the best minimum (up to half of
+//  it, at most stealBatch elements).  The batch is taken with dequeue_n
+//  under the victim's lock and enqueued into the thief's shard under its
+//  own, so every shard's nodes stay in its own pool, which keeps reusing
+//  them.  Thieves only ever try a victim's lock, and no worker holds two
+//  locks at once.  Each
+//  worker sees its own shard in strict order, equal priorities in enqueue
+//  order; across workers the order is as relaxed as the slack allows.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template<typename T, typename Priority = int, typename Compare = std::less<Priority>,
+         typename Alloc = std::allocator<T>>
+    requires is_arithmetic_v<Priority>
+class stealing_priorityqueue {
+private:
+    using QUEUE = avl_priorityqueue<T, Priority, Compare, Alloc>;
+
+    struct alignas(64) SHARD {
+        mutex lock;  // waited for by the owner, only tried by thieves
+        QUEUE pq;  // guarded by lock
+        atomic<int> count{0};  // pq.Size(), published for lock free reads
+        atomic<Priority> top{};  // minimum priority in pq when count > 0
+
+        SHARD(const Compare& comp, const Alloc& alloc) : pq(comp, alloc) {
+        }
+    };
+
+    deque<SHARD> shards;  // never grows after construction, so shards stay put
+    int workers;  // # of shards, one per worker
+    Priority slack;  // how far behind the hint a worker's minimum may fall
+    int stealBatch;  // most elements taken by one steal
+    atomic<int> size;  // # of elements, a snapshot under concurrent updates
+    atomic<Priority> hint;  // best published minimum at the last scan
+    [[no_unique_address]] Compare comp;  // orders the priorities
+
+    // Republishes the shard's size and minimum; call with its lock held.
+    static void publish(SHARD& shard) {
+        int count = shard.pq.Size();
+        if (count > 0) {
+            shard.top.store((*shard.pq.cbegin()).first, memory_order_relaxed);
+        }
+        shard.count.store(count, memory_order_release);
+    }
+
+    // Lowers the hint to priority if that comes first.
+    void offerHint(Priority priority) {
+        Priority current = hint.load(memory_order_relaxed);
+        while (comp(priority, current) &&
+               !hint.compare_exchange_weak(current, priority, memory_order_relaxed)) {
+        }
+    }
+
+    // Does priority a come more than slack after b?  Whether b + slack
+    // comes after b tells which way the comparator runs, so a max-queue
+    // (greater) measures slack downwards.
+    bool behind(Priority a, Priority b) const {
+        Priority later = b + slack;
+        if (!comp(b, later)) {
+            later = b - slack;
+        }
+        return comp(later, a);
+    }
+
+    // Scans the published minima, refreshes the hint and moves the front
+    // batch of the best other shard into the worker's own, if that beats
+    // the worker's own minimum by more than slack (or the worker has none).
+    // Gives up when the victim is busy; the caller will be back.
+    // O(workers), plus O(logn + batch) to take the batch from the victim's
+    // n elements and O(batch * logm) to add it to the worker's m
+    void steal(int worker) {
+        SHARD& own = shards[worker];
+        bool ownHas = own.count.load(memory_order_acquire) > 0;
+        Priority ownTop = own.top.load(memory_order_relaxed);
+        int victim = -1;
+        Priority best{};
+        for (int i = 0; i < workers; i++) {
+            if (i == worker || shards[i].count.load(memory_order_acquire) == 0) {
+                continue;
+            }
+            Priority top = shards[i].top.load(memory_order_relaxed);
+            if (victim < 0 || comp(top, best)) {
+                victim = i;
+                best = top;
+            }
+        }
+        if (victim < 0) {
+            if (ownHas) {
+                hint.store(ownTop, memory_order_relaxed);
+            }
+            return;
+        }
+        hint.store(ownHas && comp(ownTop, best) ? ownTop : best, memory_order_relaxed);
+        if (ownHas && !behind(ownTop, best)) {
+            return;
+        }
+        SHARD& from = shards[victim];
+        if (!from.lock.try_lock()) {
+            return;
+        }
+        vector<Priority> priorities;
+        vector<T> values;
+        {
+            lock_guard<mutex> guard(from.lock, adopt_lock);
+            int count = from.pq.Size();
+            if (count == 0) {
+                return;
+            }
+            int k = max(1, min(stealBatch, count / 2));
+            priorities.reserve(k);
+            values.reserve(k);
+            for (auto it = from.pq.cbegin(); (int)priorities.size() < k; ++it) {
+                priorities.push_back((*it).first);
+            }
+            from.pq.dequeue_n(k, back_inserter(values));
+            publish(from);
+        }
+        lock_guard<mutex> guard(own.lock);
+        for (size_t i = 0; i < values.size(); i++) {
+            own.pq.enqueue(std::move(values[i]), priorities[i]);
+        }
+        publish(own);
+    }
+
+public:
+    //
+    // constructor:
+    //
+    // Creates empty shards for the given # of workers, numbered from 0.  A
+    // worker steals when its minimum comes more than slack after the best
+    // one around, and takes at most stealBatch elements at a time.  Every
+    // shard allocates its nodes through a copy of alloc.
+    // O(workers)
+    //
+    explicit stealing_priorityqueue(int workers, Priority slack = Priority(), int stealBatch = 32,
+                                    const Compare& comp = Compare(), const Alloc& alloc = Alloc())
+        : workers(max(1, workers)), slack(slack), stealBatch(max(1, stealBatch)), size(0),
+          hint(Priority()), comp(comp) {
+        for (int i = 0; i < this->workers; i++) {
+            shards.emplace_back(comp, alloc);
+        }
+    }
+
+    stealing_priorityqueue(const stealing_priorityqueue&) = delete;
+    stealing_priorityqueue& operator=(const stealing_priorityqueue&) = delete;
+
+    //
+    // enqueue / emplace:
+    //
+    // Inserts the value with the given priority into the worker's shard.
+    // O(logn) for the shard's n elements
+    //
+    void enqueue(const T& value, const Priority& priority, int worker) {
+        emplace(worker, priority, value);
+    }
+
+    void enqueue(T&& value, const Priority& priority, int worker) {
+        emplace(worker, priority, std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace(int worker, const Priority& priority, Args&&... args) {
+        SHARD& own = shards[worker];
+        {
+            lock_guard<mutex> guard(own.lock);
+            own.pq.emplace(priority, std::forward<Args>(args)...);
+            publish(own);
+            size.fetch_add(1, memory_order_release);
+        }
+        offerHint(priority);
+    }
+
+    //
+    // try_dequeue / dequeue:
+    //
+    // Removes the front element of the worker's shard, stealing a batch
+    // first when the shard is empty or its minimum has fallen more than
+    // slack behind the hint, and moves its value into valueOut (or the
+    // returned optional).  Returns false (an empty optional) when the shard
+    // is still empty, which may happen while other shards are busy; check
+    // Size to tell that apart from an empty queue.  dequeue returns T()
+    // instead.
+    // O(logn) for the shard's n elements, plus the steal
+    //
+    bool try_dequeue(T& valueOut, int worker) {
+        SHARD& own = shards[worker];
+        if (own.count.load(memory_order_acquire) == 0 ||
+            behind(own.top.load(memory_order_relaxed), hint.load(memory_order_relaxed))) {
+            steal(worker);
+        }
+        lock_guard<mutex> guard(own.lock);
+        if (own.pq.Size() == 0) {
+            return false;
+        }
+        valueOut = own.pq.dequeue();
+        publish(own);
+        size.fetch_sub(1, memory_order_relaxed);
+        return true;
+    }
+
+    optional<T> try_dequeue(int worker) {
+        T valueOut{};
+        if (!try_dequeue(valueOut, worker)) {
+            return nullopt;
+        }
+        return valueOut;
+    }
+
+    T dequeue(int worker) {
+        T valueOut{};
+        try_dequeue(valueOut, worker);
+        return valueOut;
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in all shards, 0 if empty.  Under
+    // concurrent updates this is a snapshot.
+    // O(1)
+    //
+    int Size() const {
+        return size.load(memory_order_relaxed);
+    }
+
+    //
+    // worker_count:
+    //
+    // Returns the # of workers (shards).
+    // O(1)
+    //
+    int worker_count() const {
+        return workers;
+    }
+};
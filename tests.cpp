@@ -13,9 +13,26 @@
 
 #include "catch.hpp"
 #include "priorityqueue.h"
+#include "dary_priorityqueue.h"
+#include "pairing_priorityqueue.h"
+#include "radix_priorityqueue.h"
+#include "bucket_priorityqueue.h"
+#include "wheel_priorityqueue.h"
+#include "concurrent_priorityqueue.h"
+#include "skiplist_priorityqueue.h"
+#include "multi_priorityqueue.h"
+#include "stealing_priorityqueue.h"
+#include "combining_priorityqueue.h"
 #include "map"
 #include "vector"
 #include "random"
+#include "memory_resource"
+#include "ranges"
+#include "algorithm"
+#include "tuple"
+#include "thread"
+#include "memory"
+#include "chrono"
 
 using namespace std;
 
@@ -415,3 +432,2119 @@ TEST_CASE("Equality operator", "[priorityqueue]") {
 
 
 
+TEST_CASE("AVL balanced priority queue", "[priorityqueue][avl]") {
+    SECTION("Ascending priorities dequeue in order") {
+        avl_priorityqueue<int> pq;
+        for (int i = 0; i < 1000; i++) {
+            pq.enqueue(i * 10, i);
+        }
+        REQUIRE(pq.Size() == 1000);
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(pq.peek() == i * 10);
+            REQUIRE(pq.dequeue() == i * 10);
+        }
+        REQUIRE(pq.Size() == 0);
+    }
+
+    SECTION("Descending priorities dequeue in order") {
+        avl_priorityqueue<int> pq;
+        for (int i = 999; i >= 0; i--) {
+            pq.enqueue(i, i);
+        }
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(pq.dequeue() == i);
+        }
+    }
+
+    SECTION("Duplicates keep FIFO order") {
+        avl_priorityqueue<string> pq;
+        pq.enqueue("Ben", 1);
+        pq.enqueue("Jen", 2);
+        pq.enqueue("Sven", 2);
+        pq.enqueue("Gwen", 3);
+        pq.enqueue("Len", 2);
+        REQUIRE(pq.toString() == "1 value: Ben\n2 value: Jen\n2 value: Sven\n2 value: Len\n3 value: Gwen\n");
+        REQUIRE(pq.dequeue() == "Ben");
+        REQUIRE(pq.dequeue() == "Jen");
+        REQUIRE(pq.dequeue() == "Sven");
+        REQUIRE(pq.dequeue() == "Len");
+        REQUIRE(pq.dequeue() == "Gwen");
+    }
+
+    SECTION("Matches the unbalanced tree on random input") {
+        srand(7);
+        priorityqueue<int> plain;
+        avl_priorityqueue<int> avl;
+        for (int i = 0; i < 2000; i++) {
+            int pr = rand() % 300;
+            plain.enqueue(i, pr);
+            avl.enqueue(i, pr);
+        }
+        REQUIRE(plain.toString() == avl.toString());
+        while (plain.Size() > 0) {
+            REQUIRE(plain.dequeue() == avl.dequeue());
+        }
+        REQUIRE(avl.Size() == 0);
+    }
+}
+TEST_CASE("d-ary heap priority queue", "[dary]") {
+    SECTION("Empty queue") {
+        dary_priorityqueue<int> pq;
+        REQUIRE(pq.Size() == 0);
+        REQUIRE(pq.dequeue() == int());
+        REQUIRE_FALSE(pq.try_peek().has_value());
+        REQUIRE_FALSE(pq.try_dequeue().has_value());
+    }
+
+    SECTION("Duplicates keep FIFO order") {
+        dary_priorityqueue<string, 2> pq;
+        pq.enqueue("Gwen", 3);
+        pq.enqueue("Jen", 2);
+        pq.enqueue("Ben", 1);
+        pq.enqueue("Sven", 2);
+        pq.enqueue("Len", 2);
+        REQUIRE(pq.Size() == 5);
+        const dary_priorityqueue<string, 2>& view = pq;
+        REQUIRE(view.peek() == "Ben");
+        REQUIRE(&view.peek() == &pq.peek());
+        REQUIRE(pq.dequeue() == "Ben");
+        REQUIRE(pq.dequeue() == "Jen");
+        REQUIRE(pq.dequeue() == "Sven");
+        REQUIRE(pq.dequeue() == "Len");
+        REQUIRE(pq.dequeue() == "Gwen");
+        REQUIRE(pq.Size() == 0);
+    }
+
+    SECTION("Matches the BST for every arity") {
+        srand(11);
+        priorityqueue<int> tree;
+        dary_priorityqueue<int, 2> binary;
+        dary_priorityqueue<int, 4> quad;
+        dary_priorityqueue<int, 8> oct;
+        for (int i = 0; i < 3000; i++) {
+            int pr = rand() % 200;
+            tree.enqueue(i, pr);
+            binary.enqueue(i, pr);
+            quad.enqueue(i, pr);
+            oct.enqueue(i, pr);
+        }
+        while (tree.Size() > 0) {
+            int expected = tree.dequeue();
+            REQUIRE(binary.dequeue() == expected);
+            REQUIRE(quad.dequeue() == expected);
+            REQUIRE(oct.dequeue() == expected);
+        }
+        REQUIRE(oct.Size() == 0);
+    }
+}
+// memory_resource that counts the calls that reach it
+class countingresource : public pmr::memory_resource {
+public:
+    int allocations = 0;
+    int deallocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocations++;
+        return pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        deallocations++;
+        pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST_CASE("Node pool allocation", "[priorityqueue][pool]") {
+    countingresource resource;
+
+    SECTION("Nodes are allocated in chunks and recycled after dequeue") {
+        priorityqueue<int, int, less<int>, unbalanced_tree, pmr::polymorphic_allocator<int>> pq(&resource);
+        for (int i = 0; i < 10000; i++) {
+            pq.enqueue(i, (i * 7919) % 10007);
+        }
+        REQUIRE(pq.Size() == 10000);
+        int chunks = resource.allocations;
+        REQUIRE(chunks > 0);
+        REQUIRE(chunks < 20);
+
+        for (int i = 0; i < 10000; i++) {
+            pq.dequeue();
+        }
+        for (int i = 0; i < 10000; i++) {
+            pq.enqueue(i, i % 50);
+        }
+        REQUIRE(resource.allocations == chunks);
+        REQUIRE(resource.deallocations == 0);
+
+        pq.clear();
+        REQUIRE(pq.Size() == 0);
+        REQUIRE(resource.deallocations == chunks);
+    }
+
+    SECTION("Non-trivial values are destroyed and the queue is reusable") {
+        avl_priorityqueue<string, int, less<int>, pmr::polymorphic_allocator<string>> pq(&resource);
+        for (int i = 0; i < 500; i++) {
+            pq.enqueue(string(40, 'a' + i % 26), i % 13);
+        }
+        pq.clear();
+        REQUIRE(resource.allocations == resource.deallocations);
+        pq.enqueue("world", 2);
+        pq.enqueue("hello", 1);
+        REQUIRE(pq.dequeue() == "hello");
+        REQUIRE(pq.dequeue() == "world");
+    }
+}
+TEST_CASE("Long duplicate lists", "[priorityqueue][dup]") {
+    priorityqueue<int> pq;
+    for (int i = 0; i < 100000; i++) {
+        pq.enqueue(i, 5);
+    }
+    pq.enqueue(-1, 1);
+    pq.enqueue(-2, 9);
+    for (int i = 100000; i < 100010; i++) {
+        pq.enqueue(i, 5);
+    }
+    REQUIRE(pq.Size() == 100012);
+    REQUIRE(pq.dequeue() == -1);
+    for (int i = 0; i < 100010; i++) {
+        REQUIRE(pq.dequeue() == i);
+        if (i == 50000) {
+            pq.enqueue(100010, 5);
+        }
+    }
+    REQUIRE(pq.dequeue() == 100010);
+    REQUIRE(pq.dequeue() == -2);
+    REQUIRE(pq.Size() == 0);
+
+    priorityqueue<char> small;
+    small.enqueue('a', 2);
+    small.enqueue('b', 2);
+    small.dequeue();
+    small.enqueue('c', 2);
+    small.enqueue('d', 1);
+    REQUIRE(small.toString() == "1 value: d\n2 value: b\n2 value: c\n");
+    char value;
+    int priority;
+    small.rewind();
+    REQUIRE(small.next(value, priority));
+    REQUIRE(value == 'd');
+    REQUIRE(small.next(value, priority));
+    REQUIRE(value == 'b');
+    REQUIRE_FALSE(small.next(value, priority));
+    REQUIRE(value == 'c');
+    REQUIRE(priority == 2);
+}
+// payload that counts how often it is copied
+struct copycounter {
+    static int copies;
+    string data;
+
+    copycounter() {}
+    explicit copycounter(string data) : data(std::move(data)) {}
+    copycounter(const copycounter& other) : data(other.data) { copies++; }
+    copycounter(copycounter&& other) noexcept : data(std::move(other.data)) {}
+    copycounter& operator=(const copycounter& other) {
+        data = other.data;
+        copies++;
+        return *this;
+    }
+    copycounter& operator=(copycounter&& other) noexcept {
+        data = std::move(other.data);
+        return *this;
+    }
+};
+int copycounter::copies = 0;
+
+TEST_CASE("Move-aware enqueue, emplace and dequeue", "[priorityqueue][move]") {
+    copycounter::copies = 0;
+    priorityqueue<copycounter> pq;
+
+    SECTION("Rvalue enqueue and dequeue never copy") {
+        pq.enqueue(copycounter(string(1024, 'x')), 2);
+        pq.enqueue(copycounter("first"), 1);
+        pq.enqueue(copycounter("second"), 1);
+        REQUIRE(pq.dequeue().data == "first");
+        REQUIRE(pq.dequeue().data == "second");
+        REQUIRE(pq.dequeue().data == string(1024, 'x'));
+        REQUIRE(copycounter::copies == 0);
+    }
+
+    SECTION("Emplace constructs in place") {
+        pq.emplace(3, "c");
+        pq.emplace(1, "a");
+        pq.emplace(2);
+        REQUIRE(pq.Size() == 3);
+        REQUIRE(pq.dequeue().data == "a");
+        REQUIRE(pq.dequeue().data == "");
+        REQUIRE(pq.dequeue().data == "c");
+        REQUIRE(copycounter::copies == 0);
+    }
+
+    SECTION("Lvalue enqueue copies exactly once") {
+        copycounter payload("keep");
+        pq.enqueue(payload, 1);
+        REQUIRE(copycounter::copies == 1);
+        REQUIRE(payload.data == "keep");
+        REQUIRE(pq.dequeue().data == "keep");
+        REQUIRE(copycounter::copies == 1);
+    }
+}
+TEST_CASE("try_peek and try_dequeue", "[priorityqueue][optional]") {
+    priorityqueue<string> pq;
+
+    SECTION("Empty queue") {
+        REQUIRE_FALSE(pq.try_peek().has_value());
+        REQUIRE_FALSE(pq.try_dequeue().has_value());
+        string value = "untouched";
+        REQUIRE_FALSE(pq.try_peek(value));
+        REQUIRE_FALSE(pq.try_dequeue(value));
+        REQUIRE(value == "untouched");
+    }
+
+    SECTION("Non-empty queue") {
+        pq.enqueue("world", 2);
+        pq.enqueue("hello", 1);
+        const priorityqueue<string>& view = pq;
+        const string& front = view.peek();
+        REQUIRE(front == "hello");
+        REQUIRE(*pq.try_peek() == "hello");
+        REQUIRE(pq.Size() == 2);
+
+        string value;
+        REQUIRE(pq.try_dequeue(value));
+        REQUIRE(value == "hello");
+        REQUIRE(*pq.try_dequeue() == "world");
+        REQUIRE(pq.Size() == 0);
+        REQUIRE_FALSE(pq.try_dequeue(value));
+    }
+}
+TEST_CASE("Copy and move", "[priorityqueue][copy]") {
+    priorityqueue<string> pq;
+    pq.enqueue("Gwen", 3);
+    pq.enqueue("Ben", 1);
+    pq.enqueue("Jen", 2);
+    pq.enqueue("Sven", 2);
+    pq.enqueue("Len", 5);
+    pq.enqueue("Ken", 4);
+    string expected = pq.toString();
+
+    SECTION("Copy constructor keeps the shape and is independent") {
+        priorityqueue<string> copy(pq);
+        REQUIRE(copy == pq);
+        REQUIRE(copy.Size() == 6);
+        REQUIRE(copy.toString() == expected);
+        REQUIRE(copy.dequeue() == "Ben");
+        copy.enqueue("Zed", 0);
+        REQUIRE(pq.toString() == expected);
+        REQUIRE(copy.dequeue() == "Zed");
+        REQUIRE(copy.dequeue() == "Jen");
+        REQUIRE(copy.dequeue() == "Sven");
+    }
+
+    SECTION("Copy assignment replaces the old contents") {
+        priorityqueue<string> copy;
+        copy.enqueue("old", 9);
+        copy = pq;
+        REQUIRE(copy == pq);
+        REQUIRE(copy.toString() == expected);
+        copy = copy;
+        REQUIRE(copy.Size() == 6);
+        priorityqueue<string> empty;
+        copy = empty;
+        REQUIRE(copy.Size() == 0);
+        REQUIRE(copy.toString() == "");
+    }
+
+    SECTION("Copy of an AVL tree keeps balancing correctly") {
+        avl_priorityqueue<int> avl;
+        for (int i = 0; i < 1000; i++) {
+            avl.enqueue(i, i / 2);
+        }
+        avl_priorityqueue<int> copy(avl);
+        REQUIRE(copy == avl);
+        for (int i = 1000; i < 2000; i++) {
+            copy.enqueue(i, i / 2);
+        }
+        for (int i = 0; i < 2000; i++) {
+            REQUIRE(copy.dequeue() == i);
+        }
+    }
+
+    SECTION("Move and swap") {
+        priorityqueue<string> moved(std::move(pq));
+        REQUIRE(pq.Size() == 0);
+        REQUIRE(moved.toString() == expected);
+
+        priorityqueue<string> target;
+        target.enqueue("old", 9);
+        target = std::move(moved);
+        REQUIRE(moved.Size() == 0);
+        REQUIRE(target.toString() == expected);
+
+        priorityqueue<string> other;
+        other.enqueue("solo", 1);
+        swap(target, other);
+        REQUIRE(other.toString() == expected);
+        REQUIRE(target.Size() == 1);
+        REQUIRE(target.dequeue() == "solo");
+        moved.enqueue("reused", 1);
+        REQUIRE(moved.dequeue() == "reused");
+    }
+
+    SECTION("Move between different memory resources copies") {
+        countingresource first, second;
+        using pmrqueue = priorityqueue<string, int, less<int>, unbalanced_tree, pmr::polymorphic_allocator<string>>;
+        pmrqueue a(&first);
+        a.enqueue("x", 2);
+        a.enqueue("y", 1);
+        pmrqueue b(&second);
+        b = std::move(a);
+        REQUIRE(a.Size() == 0);
+        REQUIRE(b.dequeue() == "y");
+        REQUIRE(b.dequeue() == "x");
+        REQUIRE(first.allocations == first.deallocations);
+        REQUIRE(second.allocations == 1);
+    }
+}
+TEST_CASE("Deep trees and long duplicate lists", "[priorityqueue][stress]") {
+    SECTION("One million duplicates") {
+        priorityqueue<string> pq;
+        for (int i = 0; i < 1000000; i++) {
+            pq.enqueue(to_string(i % 10), 7);
+        }
+        priorityqueue<string> copy(pq);
+        REQUIRE(copy == pq);
+        copy.enqueue("x", 7);
+        REQUIRE_FALSE(copy == pq);
+        REQUIRE_FALSE(pq == copy);
+        string text = pq.toString();
+        REQUIRE(text.size() == 1000000 * string("7 value: 0\n").size());
+        pq.clear();
+        REQUIRE(pq.Size() == 0);
+    }
+
+    SECTION("Degenerate sorted tree") {
+        priorityqueue<string> pq;
+        for (int i = 0; i < 20000; i++) {
+            pq.enqueue(to_string(i), i);
+        }
+        pq.enqueue("dup", 19999);
+        priorityqueue<string> copy(pq);
+        REQUIRE(copy == pq);
+        string text = pq.toString();
+        REQUIRE(text.substr(0, 11) == "0 value: 0\n");
+        REQUIRE(text.substr(text.size() - 17) == "19999 value: dup\n");
+        pq.clear();
+        REQUIRE(pq.Size() == 0);
+    }
+
+    SECTION("Shape mismatch in either direction") {
+        priorityqueue<int> left, right;
+        left.enqueue(1, 2);
+        left.enqueue(2, 1);
+        right.enqueue(1, 2);
+        right.enqueue(2, 3);
+        REQUIRE_FALSE(left == right);
+        REQUIRE_FALSE(right == left);
+    }
+}
+static_assert(std::forward_iterator<priorityqueue<int>::const_iterator>);
+static_assert(std::ranges::forward_range<priorityqueue<string>>);
+static_assert(std::ranges::forward_range<const avl_priorityqueue<string>>);
+static_assert(std::forward_iterator<bucket_priorityqueue<string>::const_iterator>);
+
+TEST_CASE("Const iterators", "[priorityqueue][iterator]") {
+    priorityqueue<string> pq;
+
+    SECTION("Empty queue") {
+        REQUIRE(pq.cbegin() == pq.cend());
+        int count = 0;
+        for (auto entry : pq) {
+            count += entry.first;
+        }
+        REQUIRE(count == 0);
+        pq.rewind();
+        string value;
+        int priority;
+        REQUIRE_FALSE(pq.next(value, priority));
+    }
+
+    SECTION("Range-for follows toString order") {
+        pq.enqueue("Gwen", 3);
+        pq.enqueue("Jen", 2);
+        pq.enqueue("Ben", 1);
+        pq.enqueue("Sven", 2);
+        pq.enqueue("Len", 2);
+        pq.enqueue("Ken", 4);
+        const priorityqueue<string>& view = pq;
+        stringstream ss;
+        for (auto [priority, value] : view) {
+            ss << priority << " value: " << value << endl;
+        }
+        REQUIRE(ss.str() == pq.toString());
+    }
+
+    SECTION("Copying elements out does not keep references into the queue") {
+        pq.enqueue("Ben", 1);
+        pq.enqueue("Jen", 2);
+        using entry = priorityqueue<string>::const_iterator::value_type;
+        static_assert(is_same_v<entry, pair<int, string>>);
+        vector<entry> copies(pq.begin(), pq.end());
+        auto it = pq.begin();
+        REQUIRE(it->first == 1);
+        REQUIRE(it->second == "Ben");
+        pq.clear();
+        pq.enqueue("Ken", 9);
+        REQUIRE(copies == vector<entry>{{1, "Ben"}, {2, "Jen"}});
+    }
+
+    SECTION("begin leaves the next cursor alone") {
+        pq.enqueue("Ben", 1);
+        pq.enqueue("Jen", 2);
+        pq.enqueue("Ken", 3);
+        string value;
+        int priority;
+        pq.rewind();
+        REQUIRE(pq.next(value, priority));
+        REQUIRE(value == "Ben");
+        int seen = 0;
+        for (auto entry : pq) {
+            seen += entry.first;
+        }
+        REQUIRE(seen == 6);
+        REQUIRE((*pq.begin()).second == "Ben");
+        REQUIRE(pq.next(value, priority));
+        REQUIRE(value == "Jen");
+    }
+
+    SECTION("Independent iterators and standard algorithms") {
+        for (int i = 0; i < 50; i++) {
+            pq.enqueue("v" + to_string(i), i % 7);
+        }
+        auto first = pq.cbegin();
+        auto second = pq.cbegin();
+        ++first;
+        REQUIRE((*second).second == "v0");
+        REQUIRE((*first).second == "v7");
+        REQUIRE((*second++).second == "v0");
+        REQUIRE(first == second);
+        REQUIRE(distance(pq.cbegin(), pq.cend()) == 50);
+        REQUIRE(count_if(pq.cbegin(), pq.cend(),
+            [](auto entry) { return entry.first == 6; }) == 7);
+        auto found = ranges::find_if(pq, [](auto entry) { return entry.second == "v13"; });
+        REQUIRE(found != pq.end());
+        REQUIRE((*found).first == 6);
+        REQUIRE(&(*pq.cbegin()).second == &pq.peek());
+    }
+}
+TEST_CASE("Priority key types and comparators", "[priorityqueue][compare]") {
+    SECTION("64-bit timestamps") {
+        priorityqueue<string, long long> pq;
+        pq.enqueue("later", 5000000000LL);
+        pq.enqueue("sooner", 4000000000LL);
+        pq.enqueue("sooner too", 4000000000LL);
+        REQUIRE(pq.toString() == "4000000000 value: sooner\n4000000000 value: sooner too\n5000000000 value: later\n");
+        REQUIRE(pq.dequeue() == "sooner");
+        long long priority = 0;
+        string value;
+        pq.rewind();
+        pq.next(value, priority);
+        REQUIRE(priority == 4000000000LL);
+    }
+
+    SECTION("Double costs") {
+        avl_priorityqueue<char, double> pq;
+        pq.enqueue('c', 2.5);
+        pq.enqueue('a', 0.25);
+        pq.enqueue('b', 0.5);
+        REQUIRE(pq.dequeue() == 'a');
+        REQUIRE(pq.dequeue() == 'b');
+        REQUIRE(pq.dequeue() == 'c');
+    }
+
+    SECTION("Max-queue without negation") {
+        priorityqueue<int, int, greater<int>> pq;
+        for (int i = 0; i < 10; i++) {
+            pq.enqueue(i, i % 4);
+        }
+        REQUIRE(pq.dequeue() == 3);
+        REQUIRE(pq.dequeue() == 7);
+        REQUIRE(pq.dequeue() == 2);
+        auto first = *pq.cbegin();
+        REQUIRE(first.first == 2);
+        REQUIRE(first.second == 6);
+    }
+
+    SECTION("Composite tenant and deadline keys") {
+        using key = tuple<int, long long>;
+        avl_priorityqueue<string, key> pq;
+        pq.enqueue("t2 early", key(2, 10));
+        pq.enqueue("t1 late", key(1, 90));
+        pq.enqueue("t1 early", key(1, 10));
+        pq.enqueue("t1 early again", key(1, 10));
+        REQUIRE(pq.dequeue() == "t1 early");
+        REQUIRE(pq.dequeue() == "t1 early again");
+        REQUIRE(pq.dequeue() == "t1 late");
+        REQUIRE(pq.dequeue() == "t2 early");
+    }
+
+    SECTION("Non-trivial keys with trivial values are destroyed") {
+        using key = tuple<string, shared_ptr<int>>;
+        auto token = make_shared<int>(0);
+        {
+            priorityqueue<int, key> pq;
+            avl_priorityqueue<int, key> avl;
+            for (int i = 0; i < 100; i++) {
+                pq.enqueue(i, key("tenant" + to_string(i % 7), token));
+                avl.enqueue(i, key("tenant" + to_string(i % 7), token));
+            }
+            REQUIRE(token.use_count() == 201);
+            pq.clear();
+            REQUIRE(token.use_count() == 101);
+            pq.enqueue(1, key("tenant", token));
+        }
+        REQUIRE(token.use_count() == 1);
+    }
+
+    SECTION("Stateful comparator") {
+        struct bydistance {
+            int target;
+            bool operator()(int a, int b) const {
+                return abs(a - target) < abs(b - target);
+            }
+        };
+        priorityqueue<int, int, bydistance> pq(bydistance{50});
+        pq.enqueue(1, 10);
+        pq.enqueue(2, 45);
+        pq.enqueue(3, 100);
+        pq.enqueue(4, 55);
+        priorityqueue<int, int, bydistance> copy(pq);
+        REQUIRE(copy.dequeue() == 2);
+        REQUIRE(copy.dequeue() == 4);
+        REQUIRE(copy.dequeue() == 1);
+        REQUIRE(copy.dequeue() == 3);
+    }
+}
+TEST_CASE("Bulk construction", "[priorityqueue][bulk]") {
+    SECTION("Sorted input builds a balanced tree") {
+        vector<pair<int, string>> backlog;
+        for (int i = 0; i < 1000; i++) {
+            backlog.push_back({i / 3, "job" + to_string(i)});
+        }
+        priorityqueue<string> pq(backlog.begin(), backlog.end());
+        REQUIRE(pq.Size() == 1000);
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(pq.dequeue() == "job" + to_string(i));
+        }
+    }
+
+    SECTION("Unsorted input matches one enqueue per element") {
+        srand(5);
+        vector<pair<int, int>> backlog;
+        priorityqueue<int> expected;
+        for (int i = 0; i < 2000; i++) {
+            int pr = rand() % 100;
+            backlog.push_back({pr, i});
+            expected.enqueue(i, pr);
+        }
+        avl_priorityqueue<int> pq(backlog.begin(), backlog.end());
+        REQUIRE(pq.toString() == expected.toString());
+        for (int i = 0; i < 500; i++) {
+            pq.enqueue(i, rand() % 100);
+            pq.dequeue();
+        }
+        REQUIRE(pq.Size() == 2000);
+    }
+
+    SECTION("enqueue_bulk merges into a non-empty queue") {
+        priorityqueue<string> pq;
+        pq.enqueue("old 2", 2);
+        pq.enqueue("old 5", 5);
+        pq.enqueue("old 2 again", 2);
+        vector<pair<int, string>> batch = {{5, "new 5"}, {1, "new 1"}, {2, "new 2"}, {9, "new 9"}};
+        pq.enqueue_bulk(batch.begin(), batch.end());
+        REQUIRE(pq.Size() == 7);
+        REQUIRE(pq.toString() ==
+            "1 value: new 1\n2 value: old 2\n2 value: old 2 again\n2 value: new 2\n"
+            "5 value: old 5\n5 value: new 5\n9 value: new 9\n");
+    }
+
+    SECTION("Copy through iterators and assign") {
+        priorityqueue<char> source;
+        source.enqueue('b', 2);
+        source.enqueue('a', 1);
+        source.enqueue('c', 2);
+        priorityqueue<char> copy(source.begin(), source.end());
+        REQUIRE(copy.toString() == source.toString());
+        vector<pair<int, char>> other = {{4, 'z'}};
+        copy.assign(other.begin(), other.end());
+        REQUIRE(copy.Size() == 1);
+        REQUIRE(copy.dequeue() == 'z');
+        copy.assign(other.end(), other.end());
+        REQUIRE(copy.Size() == 0);
+    }
+
+    SECTION("d-ary heap heapify") {
+        srand(9);
+        vector<pair<int, int>> backlog;
+        for (int i = 0; i < 3000; i++) {
+            backlog.push_back({rand() % 50, i});
+        }
+        priorityqueue<int> expected(backlog.begin(), backlog.end());
+        dary_priorityqueue<int> heap(backlog.begin(), backlog.begin() + 100);
+        heap.enqueue_bulk(backlog.begin() + 100, backlog.end());
+        while (expected.Size() > 0) {
+            REQUIRE(heap.dequeue() == expected.dequeue());
+        }
+    }
+}
+TEST_CASE("Batch dequeue", "[priorityqueue][batch]") {
+    priorityqueue<int> pq;
+    avl_priorityqueue<int> avl;
+    priorityqueue<int> expected;
+    srand(3);
+    for (int i = 0; i < 3000; i++) {
+        int pr = rand() % 400;
+        pq.enqueue(i, pr);
+        avl.enqueue(i, pr);
+        expected.enqueue(i, pr);
+    }
+
+    SECTION("dequeue_n matches repeated dequeue") {
+        vector<int> batch;
+        vector<int> avlBatch;
+        while (expected.Size() > 0) {
+            size_t k = 1 + rand() % 300;
+            batch.clear();
+            avlBatch.clear();
+            pq.dequeue_n(k, back_inserter(batch));
+            avl.dequeue_n(k, back_inserter(avlBatch));
+            REQUIRE(batch == avlBatch);
+            for (int value : batch) {
+                REQUIRE(value == expected.dequeue());
+            }
+            REQUIRE(pq.Size() == expected.Size());
+            REQUIRE(avl.Size() == expected.Size());
+        }
+        batch.clear();
+        pq.dequeue_n(5, back_inserter(batch));
+        REQUIRE(batch.empty());
+    }
+
+    SECTION("dequeue_n into a fixed array") {
+        int values[64];
+        int* end = pq.dequeue_n(64, values);
+        REQUIRE(end == values + 64);
+        for (int value : values) {
+            REQUIRE(value == expected.dequeue());
+        }
+        REQUIRE(pq.peek() == expected.peek());
+    }
+
+    SECTION("drain_until is inclusive") {
+        vector<string> drained;
+        priorityqueue<string> small;
+        small.enqueue("c", 3);
+        small.enqueue("a", 1);
+        small.enqueue("b1", 2);
+        small.enqueue("b2", 2);
+        small.drain_until(2, back_inserter(drained));
+        REQUIRE(drained == vector<string>{"a", "b1", "b2"});
+        REQUIRE(small.Size() == 1);
+        small.drain_until(0, back_inserter(drained));
+        REQUIRE(small.Size() == 1);
+
+        vector<int> avlDrained;
+        avl.drain_until(200, back_inserter(avlDrained));
+        for (int value : avlDrained) {
+            REQUIRE(value == expected.dequeue());
+        }
+        REQUIRE(avl.peek() == expected.peek());
+    }
+}
+TEST_CASE("Cached minimum", "[priorityqueue][min]") {
+    SECTION("Tracks enqueue, dequeue and duplicate promotion") {
+        priorityqueue<string> pq;
+        pq.enqueue("five", 5);
+        REQUIRE(pq.peek() == "five");
+        pq.enqueue("seven", 7);
+        REQUIRE(pq.peek() == "five");
+        pq.enqueue("three", 3);
+        pq.enqueue("three again", 3);
+        REQUIRE(pq.peek() == "three");
+        REQUIRE(pq.dequeue() == "three");
+        REQUIRE(pq.peek() == "three again");
+        pq.enqueue("four", 4);
+        REQUIRE(pq.dequeue() == "three again");
+        REQUIRE(pq.peek() == "four");
+        REQUIRE(pq.dequeue() == "four");
+        REQUIRE(pq.peek() == "five");
+        pq.clear();
+        REQUIRE_FALSE(pq.try_peek().has_value());
+        pq.enqueue("again", 9);
+        REQUIRE(pq.peek() == "again");
+    }
+
+    SECTION("Survives AVL rotations, copies, moves and bulk builds") {
+        srand(21);
+        avl_priorityqueue<int> pq;
+        priorityqueue<int> expected;
+        for (int i = 0; i < 3000; i++) {
+            int pr = rand() % 1000;
+            pq.enqueue(i, pr);
+            expected.enqueue(i, pr);
+            REQUIRE(pq.peek() == expected.peek());
+            if (i % 3 == 0) {
+                REQUIRE(pq.dequeue() == expected.dequeue());
+            }
+        }
+        avl_priorityqueue<int> copy(pq);
+        REQUIRE(copy.peek() == expected.peek());
+        avl_priorityqueue<int> moved(std::move(copy));
+        REQUIRE(moved.peek() == expected.peek());
+        vector<pair<int, int>> batch = {{-5, 42}, {2000, 43}};
+        moved.enqueue_bulk(batch.begin(), batch.end());
+        REQUIRE(moved.peek() == 42);
+    }
+}
+// value whose copy throws once copiesLeft runs out; its move may throw too,
+// so containers copy it rather than move it
+struct brittle {
+    string name;
+    static inline int copiesLeft = 0;
+    brittle() = default;
+    brittle(string name) : name(std::move(name)) {
+    }
+    brittle(const brittle& other) : name(other.name) {
+        if (copiesLeft-- == 0) {
+            throw runtime_error("copy");
+        }
+    }
+    brittle(brittle&& other) : name(std::move(other.name)) {
+    }
+    brittle& operator=(const brittle&) = default;
+    brittle& operator=(brittle&&) = default;
+};
+
+TEST_CASE("Merge", "[priorityqueue][merge]") {
+    SECTION("Equal priorities keep this queue's elements first") {
+        priorityqueue<string> a, b;
+        a.enqueue("a1", 1);
+        a.enqueue("a3", 3);
+        a.enqueue("a3 again", 3);
+        b.enqueue("b3", 3);
+        b.enqueue("b2", 2);
+        b.enqueue("b9", 9);
+        b.enqueue("b3 again", 3);
+        a.merge(std::move(b));
+        REQUIRE(a.Size() == 7);
+        REQUIRE(b.Size() == 0);
+        REQUIRE(a.toString() ==
+            "1 value: a1\n2 value: b2\n3 value: a3\n3 value: a3 again\n"
+            "3 value: b3\n3 value: b3 again\n9 value: b9\n");
+        b.enqueue("reused", 4);
+        REQUIRE(b.dequeue() == "reused");
+        REQUIRE(a.dequeue() == "a1");
+        REQUIRE(a.dequeue() == "b2");
+        REQUIRE(a.dequeue() == "a3");
+    }
+
+    SECTION("Merge into an empty queue and of an empty queue") {
+        avl_priorityqueue<int> a, b, empty;
+        for (int i = 0; i < 100; i++) {
+            b.enqueue(i, i);
+        }
+        a.merge(std::move(b));
+        a.merge(std::move(empty));
+        REQUIRE(a.Size() == 100);
+        REQUIRE(a.peek() == 0);
+        for (int i = 0; i < 100; i++) {
+            REQUIRE(a.dequeue() == i);
+        }
+    }
+
+    SECTION("Small and large shards against a reference") {
+        srand(17);
+        avl_priorityqueue<int> big, small, other;
+        priorityqueue<int> expected;
+        for (int i = 0; i < 4000; i++) {
+            int pr = rand() % 500;
+            big.enqueue(i, pr);
+            expected.enqueue(i, pr);
+        }
+        for (int i = 4000; i < 4050; i++) {
+            int pr = rand() % 500;
+            small.enqueue(i, pr);
+            expected.enqueue(i, pr);
+        }
+        big.merge(std::move(small));
+        for (int i = 4050; i < 8000; i++) {
+            int pr = rand() % 500;
+            other.enqueue(i, pr);
+            expected.enqueue(i, pr);
+        }
+        big.merge(std::move(other));
+        REQUIRE(big.Size() == 8000);
+        REQUIRE(big.toString() == expected.toString());
+        for (int i = 0; i < 8000; i++) {
+            REQUIRE(big.dequeue() == expected.dequeue());
+        }
+    }
+
+    SECTION("Nodes change owner without allocating") {
+        countingresource resource;
+        using pmrqueue = priorityqueue<string, int, less<int>, unbalanced_tree, pmr::polymorphic_allocator<string>>;
+        pmrqueue a(&resource);
+        pmrqueue b(&resource);
+        for (int i = 0; i < 100; i++) {
+            a.enqueue("a" + to_string(i), i);
+            b.enqueue("b" + to_string(i), i);
+        }
+        int chunks = resource.allocations;
+        a.merge(std::move(b));
+        REQUIRE(resource.allocations == chunks);
+        REQUIRE(a.Size() == 200);
+        REQUIRE(a.dequeue() == "a0");
+        REQUIRE(a.dequeue() == "b0");
+        b.enqueue("new", 1);
+        a.clear();
+        b.clear();
+        REQUIRE(resource.allocations == resource.deallocations);
+    }
+
+    SECTION("Different resources move the payloads") {
+        countingresource first, second;
+        using pmrqueue = priorityqueue<string, int, less<int>, unbalanced_tree, pmr::polymorphic_allocator<string>>;
+        pmrqueue a(&first);
+        pmrqueue b(&second);
+        a.enqueue("a", 2);
+        b.enqueue("b", 1);
+        b.enqueue("c", 2);
+        a.merge(std::move(b));
+        REQUIRE(b.Size() == 0);
+        REQUIRE(second.allocations == second.deallocations);
+        REQUIRE(a.dequeue() == "b");
+        REQUIRE(a.dequeue() == "a");
+        REQUIRE(a.dequeue() == "c");
+    }
+
+    SECTION("A throwing copy leaves both queues unchanged") {
+        countingresource first, second;
+        using pmrqueue = avl_priorityqueue<brittle, int, less<int>, pmr::polymorphic_allocator<brittle>>;
+        pmrqueue a(&first);
+        pmrqueue b(&second);
+        a.enqueue(brittle("a"), 0);
+        for (int i = 0; i < 10; i++) {
+            b.enqueue(brittle(to_string(i)), i);
+        }
+        brittle::copiesLeft = 5;
+        REQUIRE_THROWS_AS(a.merge(std::move(b)), runtime_error);
+        REQUIRE(a.Size() == 1);
+        REQUIRE(b.Size() == 10);
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(b.dequeue().name == to_string(i));
+        }
+        REQUIRE(a.dequeue().name == "a");
+    }
+}
+TEST_CASE("Split", "[priorityqueue][split]") {
+    SECTION("Duplicate lists move as units") {
+        priorityqueue<string> pq;
+        pq.enqueue("c1", 3);
+        pq.enqueue("a", 1);
+        pq.enqueue("e1", 5);
+        pq.enqueue("c2", 3);
+        pq.enqueue("d", 4);
+        pq.enqueue("e2", 5);
+        pq.enqueue("b", 2);
+        priorityqueue<string> upper = pq.split(3);
+        REQUIRE(pq.Size() == 4);
+        REQUIRE(upper.Size() == 3);
+        REQUIRE(pq.toString() == "1 value: a\n2 value: b\n3 value: c1\n3 value: c2\n");
+        REQUIRE(upper.toString() == "4 value: d\n5 value: e1\n5 value: e2\n");
+        REQUIRE(upper.peek() == "d");
+        REQUIRE(pq.peek() == "a");
+    }
+
+    SECTION("Thresholds outside the queue move everything or nothing") {
+        avl_priorityqueue<int> pq;
+        for (int i = 0; i < 100; i++) {
+            pq.enqueue(i, i % 10);
+        }
+        avl_priorityqueue<int> none = pq.split(9);
+        REQUIRE(none.Size() == 0);
+        REQUIRE(pq.Size() == 100);
+        avl_priorityqueue<int> all = pq.split(-1);
+        REQUIRE(pq.Size() == 0);
+        REQUIRE(all.Size() == 100);
+        REQUIRE(all.peek() == 0);
+        avl_priorityqueue<int> empty;
+        REQUIRE(empty.split(0).Size() == 0);
+        pq.enqueue(7, 7);
+        REQUIRE(pq.dequeue() == 7);
+    }
+
+    SECTION("Random splits against a reference") {
+        srand(23);
+        avl_priorityqueue<int> pq;
+        multimap<int, int> expected;
+        for (int i = 0; i < 5000; i++) {
+            int pr = rand() % 2000;
+            pq.enqueue(i, pr);
+            expected.emplace(pr, i);
+        }
+        for (int threshold : {1500, 1000, 200, 1999, 700}) {
+            avl_priorityqueue<int> upper = pq.split(threshold);
+            multimap<int, int> expectedUpper(expected.upper_bound(threshold), expected.end());
+            expected.erase(expected.upper_bound(threshold), expected.end());
+            REQUIRE(pq.Size() == (int)expected.size());
+            REQUIRE(upper.Size() == (int)expectedUpper.size());
+            auto it = expectedUpper.begin();
+            for (auto [priority, value] : upper) {
+                REQUIRE(priority == it->first);
+                REQUIRE(value == it->second);
+                ++it;
+            }
+            // Both halves stay fully usable.
+            if (!expectedUpper.empty()) {
+                REQUIRE(upper.dequeue() == expectedUpper.begin()->second);
+                expectedUpper.erase(expectedUpper.begin());
+            }
+            upper.enqueue(-1, threshold + 1);
+            expectedUpper.emplace(threshold + 1, -1);
+            REQUIRE(upper.peek() == expectedUpper.begin()->second);
+            pq.enqueue(-2, threshold);
+            expected.emplace(threshold, -2);
+        }
+        auto it = expected.begin();
+        while (pq.Size() > 0) {
+            REQUIRE(pq.dequeue() == it->second);
+            ++it;
+        }
+    }
+
+    SECTION("Nodes change owner without allocating") {
+        countingresource resource;
+        using pmrqueue = avl_priorityqueue<string, int, less<int>, pmr::polymorphic_allocator<string>>;
+        pmrqueue pq(&resource);
+        for (int i = 0; i < 1000; i++) {
+            pq.enqueue(to_string(i), i);
+        }
+        int chunks = resource.allocations;
+        pmrqueue upper = pq.split(499);
+        REQUIRE(resource.allocations == chunks);
+        REQUIRE(upper.Size() == 500);
+        REQUIRE(upper.get_allocator() == pq.get_allocator());
+        pq.clear();
+        REQUIRE(upper.dequeue() == "500");
+        upper.enqueue("new", 0);
+        REQUIRE(upper.dequeue() == "new");
+        pq.merge(std::move(upper));
+        REQUIRE(pq.Size() == 499);
+        REQUIRE(pq.peek() == "501");
+        pq.clear();
+        REQUIRE(resource.allocations == resource.deallocations);
+    }
+
+    SECTION("Split/merge round trips free the chunks they empty") {
+        countingresource resource;
+        using pmrqueue = avl_priorityqueue<string, int, less<int>, pmr::polymorphic_allocator<string>>;
+        pmrqueue pq(&resource);
+        for (int i = 0; i < 64; i++) {
+            pq.enqueue(to_string(i), i);
+        }
+        int most = 0;
+        for (int round = 0; round < 5000; round++) {
+            pmrqueue upper = pq.split(round % 64);
+            auto h = upper.enqueue(to_string(round), 64 + round % 7);
+            pq.enqueue(to_string(round), round % 64);
+            pq.merge(std::move(upper));
+            pq.dequeue();
+            pq.erase(h);
+            most = max(most, resource.allocations - resource.deallocations);
+        }
+        REQUIRE(pq.Size() == 64);
+        REQUIRE(most <= 16);
+        pq.clear();
+        REQUIRE(resource.allocations == resource.deallocations);
+    }
+
+    SECTION("Comparators and the unbalanced tree") {
+        priorityqueue<int, int, greater<int>> pq;
+        for (int i = 0; i < 20; i++) {
+            pq.enqueue(i, i);
+        }
+        priorityqueue<int, int, greater<int>> lower = pq.split(5);
+        REQUIRE(pq.Size() == 15);
+        REQUIRE(lower.Size() == 5);
+        REQUIRE(pq.peek() == 19);
+        REQUIRE(lower.peek() == 4);
+    }
+}
+TEST_CASE("Handles", "[priorityqueue][handle]") {
+    SECTION("Erase from every position") {
+        priorityqueue<string> pq;
+        auto b = pq.enqueue("b", 2);
+        auto a = pq.enqueue("a", 1);
+        auto d = pq.enqueue("d", 4);
+        auto c1 = pq.enqueue("c1", 3);
+        auto c2 = pq.enqueue("c2", 3);
+        auto c3 = pq.enqueue("c3", 3);
+        auto e = pq.enqueue("e", 5);
+        REQUIRE(c2.value() == "c2");
+        REQUIRE(c2.priority() == 3);
+
+        pq.erase(c2);  // middle of a duplicate list
+        pq.erase(c3);  // tail of a duplicate list
+        pq.enqueue("c4", 3);
+        REQUIRE(pq.toString() ==
+            "1 value: a\n2 value: b\n3 value: c1\n3 value: c4\n4 value: d\n5 value: e\n");
+        pq.erase(c1);  // head of a duplicate list
+        pq.erase(b);  // root with two children
+        pq.erase(e);  // leaf
+        REQUIRE(pq.Size() == 3);
+        REQUIRE(pq.toString() == "1 value: a\n3 value: c4\n4 value: d\n");
+        pq.erase(a);  // the minimum
+        REQUIRE(pq.peek() == "c4");
+        pq.erase(d);
+        REQUIRE(pq.dequeue() == "c4");
+        REQUIRE(pq.Size() == 0);
+    }
+
+    SECTION("Update priority relinks the element") {
+        avl_priorityqueue<string> pq;
+        auto x = pq.enqueue("x", 10);
+        pq.enqueue("y", 5);
+        pq.enqueue("z", 5);
+        pq.update_priority(x, 1);  // decrease-key to the front
+        REQUIRE(pq.peek() == "x");
+        REQUIRE(x.priority() == 1);
+        pq.update_priority(x, 5);  // joins the back of an existing list
+        REQUIRE(pq.toString() == "5 value: y\n5 value: z\n5 value: x\n");
+        pq.update_priority(x, 5);  // equivalent priority: unchanged
+        REQUIRE(pq.toString() == "5 value: y\n5 value: z\n5 value: x\n");
+        REQUIRE(pq.dequeue() == "y");
+        REQUIRE(pq.dequeue() == "z");
+        REQUIRE(pq.dequeue() == "x");
+    }
+
+    SECTION("Handles follow their elements through merge") {
+        avl_priorityqueue<int> a, b;
+        a.enqueue(1, 1);
+        auto h = b.enqueue(2, 2);
+        b.enqueue(3, 2);
+        a.merge(std::move(b));
+        a.update_priority(h, 0);
+        REQUIRE(a.dequeue() == 2);
+        REQUIRE(a.dequeue() == 1);
+        REQUIRE(a.dequeue() == 3);
+    }
+
+    SECTION("Random updates and erases against a reference") {
+        srand(31);
+        avl_priorityqueue<int> pq;
+        map<pair<int, int>, int> expected;  // (priority, order) -> value
+        vector<avl_priorityqueue<int>::handle> handles;
+        vector<pair<int, int>> keys;
+        int order = 0;
+        for (int i = 0; i < 3000; i++) {
+            int pr = rand() % 300;
+            handles.push_back(pq.enqueue(i, pr));
+            keys.push_back({pr, order});
+            expected[{pr, order++}] = i;
+        }
+        for (int step = 0; step < 3000; step++) {
+            size_t i = rand() % handles.size();
+            if (step % 3 == 0) {
+                pq.erase(handles[i]);
+                expected.erase(keys[i]);
+                handles[i] = handles.back();
+                keys[i] = keys.back();
+                handles.pop_back();
+                keys.pop_back();
+            }
+            else {
+                int pr = rand() % 300;
+                pq.update_priority(handles[i], pr);
+                if (pr != keys[i].first) {
+                    int value = expected[keys[i]];
+                    expected.erase(keys[i]);
+                    keys[i] = {pr, order};
+                    expected[{pr, order++}] = value;
+                }
+            }
+        }
+        REQUIRE(pq.Size() == (int)expected.size());
+        for (auto& [key, value] : expected) {
+            REQUIRE(pq.dequeue() == value);
+        }
+        REQUIRE(pq.Size() == 0);
+    }
+}
+TEST_CASE("Pairing heap priority queue", "[pairing]") {
+    SECTION("Same order as the BST, duplicates first in first out") {
+        pairing_priorityqueue<string> heap;
+        priorityqueue<string> pq;
+        srand(41);
+        for (int i = 0; i < 2000; i++) {
+            int pr = rand() % 50;
+            heap.enqueue(to_string(i), pr);
+            pq.enqueue(to_string(i), pr);
+        }
+        REQUIRE(heap.Size() == 2000);
+        while (pq.Size() > 0) {
+            REQUIRE(heap.peek() == pq.peek());
+            REQUIRE(heap.dequeue() == pq.dequeue());
+        }
+        REQUIRE(heap.Size() == 0);
+        REQUIRE(heap.dequeue() == "");
+        REQUIRE_FALSE(heap.try_peek().has_value());
+    }
+
+    SECTION("Decrease-key, increase-key and erase") {
+        pairing_priorityqueue<string> heap;
+        auto x = heap.enqueue("x", 10);
+        auto y = heap.enqueue("y", 5);
+        heap.enqueue("z", 5);
+        auto w = heap.enqueue("w", 7);
+        heap.update_priority(x, 1);
+        REQUIRE(heap.peek() == "x");
+        REQUIRE(x.priority() == 1);
+        heap.update_priority(x, 5);  // joins the back of the 5s
+        heap.update_priority(y, 5);  // equivalent: stays first
+        heap.erase(w);
+        REQUIRE(heap.Size() == 3);
+        REQUIRE(heap.dequeue() == "y");
+        REQUIRE(heap.dequeue() == "z");
+        REQUIRE(heap.dequeue() == "x");
+    }
+
+    SECTION("Random updates and erases against a reference") {
+        srand(43);
+        pairing_priorityqueue<int, int, greater<int>> heap;
+        map<pair<int, int>, int> expected;  // (-priority, order) -> value
+        vector<pairing_priorityqueue<int, int, greater<int>>::handle> handles;
+        vector<pair<int, int>> keys;
+        int order = 0;
+        for (int step = 0; step < 20000; step++) {
+            int op = rand() % 4;
+            if (op == 0 || handles.empty()) {
+                int pr = rand() % 1000;
+                handles.push_back(heap.enqueue(step, pr));
+                keys.push_back({-pr, order});
+                expected[{-pr, order++}] = step;
+            }
+            else if (op == 1) {
+                size_t i = rand() % handles.size();
+                int pr = rand() % 1000;
+                heap.update_priority(handles[i], pr);
+                if (-pr != keys[i].first) {
+                    int value = expected[keys[i]];
+                    expected.erase(keys[i]);
+                    keys[i] = {-pr, order};
+                    expected[{-pr, order++}] = value;
+                }
+            }
+            else if (op == 2) {
+                size_t i = rand() % handles.size();
+                heap.erase(handles[i]);
+                expected.erase(keys[i]);
+                handles[i] = handles.back();
+                keys[i] = keys.back();
+                handles.pop_back();
+                keys.pop_back();
+            }
+            else {
+                int value = heap.dequeue();
+                REQUIRE(value == expected.begin()->second);
+                size_t i = find(keys.begin(), keys.end(), expected.begin()->first) - keys.begin();
+                expected.erase(expected.begin());
+                handles[i] = handles.back();
+                keys[i] = keys.back();
+                handles.pop_back();
+                keys.pop_back();
+            }
+            REQUIRE(heap.Size() == (int)expected.size());
+        }
+    }
+
+    SECTION("Nodes come from the allocator in chunks") {
+        countingresource resource;
+        {
+            pairing_priorityqueue<string, int, less<int>, pmr::polymorphic_allocator<string>> heap(&resource);
+            for (int i = 0; i < 1000; i++) {
+                heap.enqueue(string(40, 'a'), i % 7);
+            }
+            REQUIRE(resource.allocations < 10);
+            pairing_priorityqueue<string, int, less<int>, pmr::polymorphic_allocator<string>> moved(std::move(heap));
+            REQUIRE(moved.Size() == 1000);
+        }
+        REQUIRE(resource.allocations == resource.deallocations);
+    }
+
+    SECTION("Non-trivial keys with trivial values are destroyed") {
+        using key = tuple<string, shared_ptr<int>>;
+        auto token = make_shared<int>(0);
+        {
+            pairing_priorityqueue<int, key> heap;
+            for (int i = 0; i < 100; i++) {
+                heap.enqueue(i, key("tenant" + to_string(i % 7), token));
+            }
+            heap.dequeue();
+            REQUIRE(token.use_count() == 100);
+            heap.clear();
+            REQUIRE(token.use_count() == 1);
+            heap.enqueue(1, key("tenant", token));
+        }
+        REQUIRE(token.use_count() == 1);
+    }
+}
+// payload that counts the live instances, moved-from ones included
+struct livecounter {
+    static int live;
+    int data = 0;
+
+    livecounter() { live++; }
+    explicit livecounter(int data) : data(data) { live++; }
+    livecounter(const livecounter& other) : data(other.data) { live++; }
+    livecounter(livecounter&& other) noexcept : data(other.data) { live++; }
+    livecounter& operator=(const livecounter&) = default;
+    livecounter& operator=(livecounter&&) noexcept = default;
+    ~livecounter() { live--; }
+};
+int livecounter::live = 0;
+
+TEST_CASE("Radix heap priority queue", "[radix]") {
+    SECTION("Monotone workload matches the BST, duplicates first in first out") {
+        radix_priorityqueue<int> radix;
+        priorityqueue<int> pq;
+        vector<int> priorities;
+        srand(47);
+        for (int i = 0; i < 1000; i++) {
+            priorities.push_back(-5000 + rand() % 100);
+            radix.enqueue(i, priorities[i]);
+            pq.enqueue(i, priorities[i]);
+        }
+        for (int i = 1000; i < 50000; i++) {
+            REQUIRE(radix.peek() == pq.peek());
+            int value = radix.dequeue();
+            REQUIRE(value == pq.dequeue());
+            // New priorities never go below the last dequeued one, and a
+            // third of them land exactly on it.
+            int last = priorities[value];
+            priorities.push_back(i % 3 == 0 ? last : last + rand() % 300);
+            radix.enqueue(i, priorities[i]);
+            pq.enqueue(i, priorities[i]);
+            REQUIRE(radix.Size() == pq.Size());
+        }
+        while (pq.Size() > 0) {
+            REQUIRE(radix.dequeue() == pq.dequeue());
+        }
+        REQUIRE(radix.Size() == 0);
+        REQUIRE(radix.dequeue() == 0);
+        REQUIRE_FALSE(radix.try_dequeue().has_value());
+    }
+
+    SECTION("Equal to the last dequeued priority, 64 bit and unsigned keys") {
+        radix_priorityqueue<string, long long> radix;
+        radix.enqueue("a", -(1LL << 40));
+        radix.enqueue("c", 1LL << 50);
+        REQUIRE(radix.dequeue() == "a");
+        radix.enqueue("b", -(1LL << 40));
+        REQUIRE(radix.peek() == "b");
+        REQUIRE(radix.dequeue() == "b");
+        REQUIRE(radix.dequeue() == "c");
+        radix.clear();
+        radix.enqueue("low", numeric_limits<long long>::min());
+        REQUIRE(radix.dequeue() == "low");
+
+        radix_priorityqueue<int, unsigned> timers;
+        for (unsigned tick : {5u, 3u, 4294967295u, 3u, 0u}) {
+            timers.enqueue((int)tick, tick);
+        }
+        vector<int> fired;
+        int value;
+        while (timers.try_dequeue(value)) {
+            fired.push_back(value);
+        }
+        REQUIRE(fired == vector<int>{0, 3, 3, 5, -1});
+    }
+
+    SECTION("Peeking does not raise the lower bound") {
+        radix_priorityqueue<int> radix;
+        radix.enqueue(5, 5);
+        radix.enqueue(100, 100);
+        REQUIRE(radix.dequeue() == 5);
+        REQUIRE(radix.peek() == 100);
+        radix.enqueue(50, 50);
+        REQUIRE(radix.peek() == 50);
+        radix.enqueue(70, 70);
+        radix.enqueue(50, 50);
+        radix.enqueue(20, 5);
+        REQUIRE(radix.peek() == 20);
+        vector<int> out;
+        while (radix.Size() > 0) {
+            out.push_back(radix.dequeue());
+        }
+        REQUIRE(out == vector<int>{20, 50, 50, 70, 100});
+    }
+
+    SECTION("Enqueueing at the last dequeued priority keeps storage bounded") {
+        livecounter::live = 0;
+        {
+            radix_priorityqueue<livecounter> radix;
+            for (int i = 0; i < 10; i++) {
+                radix.enqueue(livecounter(i), 7);
+            }
+            int peak = 0;
+            for (int i = 10; i < 100000; i++) {
+                REQUIRE(radix.dequeue().data == i - 10);
+                radix.enqueue(livecounter(i), 7);
+                peak = max(peak, livecounter::live);
+            }
+            REQUIRE(radix.Size() == 10);
+            REQUIRE(peak <= 200);
+            while (radix.Size() > 0) {
+                radix.dequeue();
+            }
+            radix.enqueue(livecounter(0), 7);
+            REQUIRE(livecounter::live <= 2);
+        }
+        REQUIRE(livecounter::live == 0);
+    }
+}
+TEST_CASE("Bucket queue", "[bucket]") {
+    SECTION("Same order as the BST, duplicates first in first out") {
+        bucket_priorityqueue<string> buckets;
+        priorityqueue<string> pq;
+        srand(53);
+        for (int round = 0; round < 20; round++) {
+            for (int i = 0; i < 500; i++) {
+                int pr = rand() % 256;
+                buckets.enqueue(to_string(round) + "/" + to_string(i), pr);
+                pq.enqueue(to_string(round) + "/" + to_string(i), pr);
+            }
+            REQUIRE(buckets.Size() == pq.Size());
+            auto it = pq.begin();
+            for (auto [priority, value] : buckets) {
+                REQUIRE(priority == (*it).first);
+                REQUIRE(value == (*it).second);
+                ++it;
+            }
+            REQUIRE(it == pq.end());
+            using entry = bucket_priorityqueue<string>::const_iterator::value_type;
+            static_assert(is_same_v<entry, pair<int, string>>);
+            vector<entry> copies(buckets.begin(), buckets.end());
+            REQUIRE((int)copies.size() == buckets.Size());
+            REQUIRE(buckets.begin()->second == copies.front().second);
+            for (int i = 0; i < 300; i++) {
+                REQUIRE(buckets.peek() == pq.peek());
+                REQUIRE(buckets.dequeue() == pq.dequeue());
+            }
+        }
+        while (pq.Size() > 0) {
+            REQUIRE(buckets.dequeue() == pq.dequeue());
+        }
+        REQUIRE(buckets.begin() == buckets.end());
+        REQUIRE(buckets.dequeue() == "");
+        REQUIRE_FALSE(buckets.try_peek().has_value());
+    }
+
+    SECTION("Edges of a wide range") {
+        bucket_priorityqueue<int, 4096> buckets;
+        for (int pr : {4095, 64, 63, 0, 4032, 64}) {
+            buckets.enqueue(pr, pr);
+        }
+        vector<int> order;
+        for (auto [priority, value] : buckets) {
+            order.push_back(priority);
+        }
+        REQUIRE(order == vector<int>{0, 63, 64, 64, 4032, 4095});
+        int value;
+        order.clear();
+        while (buckets.try_dequeue(value)) {
+            order.push_back(value);
+        }
+        REQUIRE(order == vector<int>{0, 63, 64, 64, 4032, 4095});
+        buckets.enqueue(7, 7);
+        bucket_priorityqueue<int, 4096> moved(std::move(buckets));
+        REQUIRE(buckets.Size() == 0);
+        REQUIRE(moved.dequeue() == 7);
+    }
+}
+TEST_CASE("Timing wheel priority queue", "[wheel]") {
+    SECTION("Fires in deadline order against a reference") {
+        mt19937_64 gen(59);
+        wheel_priorityqueue<int> wheel;
+        avl_priorityqueue<int, unsigned long long> expected;
+        vector<wheel_priorityqueue<int>::handle> handles;
+        vector<avl_priorityqueue<int, unsigned long long>::handle> expectedHandles;
+        vector<char> pending;
+        unsigned long long now = 0;
+        vector<int> fired;
+        vector<int> expectedFired;
+        auto fire = [&](int value) {
+            fired.push_back(value);
+            pending[value] = 0;
+        };
+        for (int step = 0; step < 30000; step++) {
+            int op = (int)(gen() % 10);
+            if (op < 5) {
+                // Mostly near deadlines, some far enough out to cascade
+                // through several levels, some due right now.
+                unsigned long long delay = gen() % 3 == 0 ? gen() % 100 : gen() % (1ULL << (gen() % 40));
+                int id = (int)handles.size();
+                handles.push_back(wheel.enqueue(id, now + delay));
+                expectedHandles.push_back(expected.enqueue(id, now + delay));
+                pending.push_back(1);
+            }
+            else if (op < 7 && !handles.empty()) {
+                int id = (int)(gen() % handles.size());
+                if (pending[id]) {
+                    REQUIRE(handles[id].value() == id);
+                    wheel.cancel(handles[id]);
+                    expected.erase(expectedHandles[id]);
+                    pending[id] = 0;
+                }
+            }
+            else if (op < 9) {
+                now += gen() % 2 == 0 ? gen() % 64 : gen() % (1ULL << (gen() % 30));
+                wheel.advance_to(now, fire);
+                expected.drain_until(now, back_inserter(expectedFired));
+                REQUIRE(wheel.now() == now);
+            }
+            else if (wheel.Size() > 0) {
+                int id = expected.peek();
+                unsigned long long deadline = handles[id].deadline();
+                REQUIRE(wheel.peek() == id);
+                REQUIRE(wheel.dequeue() == id);
+                expectedFired.push_back(expected.dequeue());
+                fired.push_back(id);
+                pending[id] = 0;
+                now = deadline;
+                REQUIRE(wheel.now() == now);
+            }
+            REQUIRE(wheel.Size() == expected.Size());
+        }
+        REQUIRE(fired == expectedFired);
+        wheel.clear();
+        REQUIRE(wheel.Size() == 0);
+        REQUIRE(wheel.now() == 0);
+        REQUIRE(wheel.dequeue() == 0);
+    }
+
+    SECTION("Callbacks may arm and cancel timers") {
+        wheel_priorityqueue<string> wheel;
+        auto later = wheel.enqueue("cancelled", 10);
+        wheel.enqueue("first", 5);
+        wheel.enqueue("second", 5);
+        vector<string> fired;
+        size_t count = wheel.advance_to(100, [&](string value) {
+            if (value == "first") {
+                wheel.cancel(later);
+                wheel.enqueue("rearmed", wheel.now() + 50);
+                wheel.enqueue("same tick", wheel.now());
+                wheel.enqueue("too late", 1000);
+            }
+            fired.push_back(value);
+        });
+        REQUIRE(count == 4);
+        REQUIRE(fired == vector<string>{"first", "second", "same tick", "rearmed"});
+        REQUIRE(wheel.Size() == 1);
+        REQUIRE(wheel.now() == 100);
+        REQUIRE(wheel.peek() == "too late");
+        REQUIRE(wheel.now() == 100);
+    }
+
+    SECTION("Peeking does not move the current tick") {
+        wheel_priorityqueue<string> wheel;
+        wheel.enqueue("far", 1000);
+        REQUIRE(wheel.peek() == "far");
+        REQUIRE(wheel.now() == 0);
+        wheel.enqueue("near", 10);
+        REQUIRE(wheel.peek() == "near");
+        auto middle = wheel.enqueue("middle", 500);
+        wheel.enqueue("far too", 1000);
+        wheel.enqueue("after", 4000);
+        REQUIRE(wheel.dequeue() == "near");
+        REQUIRE(wheel.peek() == "middle");
+        wheel.cancel(middle);
+        REQUIRE(wheel.peek() == "far");
+        wheel.enqueue("sooner", 999);
+        REQUIRE(wheel.peek() == "sooner");
+        vector<string> fired;
+        while (wheel.Size() > 0) {
+            fired.push_back(wheel.dequeue());
+        }
+        REQUIRE(fired == vector<string>{"sooner", "far", "far too", "after"});
+    }
+}
+// checks a concurrent queue against the BST from a single thread
+template<typename Q>
+void checkLikeBst(Q& q, unsigned seed, int count) {
+    priorityqueue<string> pq;
+    srand(seed);
+    for (int i = 0; i < count; i++) {
+        int pr = rand() % 40;
+        q.enqueue(to_string(i), pr);
+        pq.enqueue(to_string(i), pr);
+        if (i % 3 == 0) {
+            REQUIRE(q.peek() == pq.peek());
+            REQUIRE(q.dequeue() == pq.dequeue());
+        }
+    }
+    REQUIRE(q.Size() == pq.Size());
+    while (pq.Size() > 0) {
+        REQUIRE(q.dequeue() == pq.dequeue());
+    }
+    REQUIRE(q.Size() == 0);
+    REQUIRE(q.dequeue() == "");
+    REQUIRE_FALSE(q.try_peek().has_value());
+    q.enqueue("again", 3);
+    q.clear();
+    REQUIRE_FALSE(q.try_dequeue().has_value());
+}
+
+// races producers against consumers polling try_dequeue and checks that
+// every element comes out exactly once
+template<typename Q>
+void checkProducersConsumers(Q& q) {
+    const int producers = 4;
+    const int perProducer = 20000;
+    atomic<int> produced(0);
+    vector<vector<int>> taken(producers);
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            for (int i = 0; i < perProducer; i++) {
+                q.enqueue(p * perProducer + i, (i * 31 + p) % 100);
+            }
+            produced.fetch_add(1);
+        });
+        threads.emplace_back([&, p]() {
+            int value;
+            while (true) {
+                if (q.try_dequeue(value)) {
+                    taken[p].push_back(value);
+                }
+                else if (produced.load() == producers && q.Size() == 0) {
+                    break;
+                }
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    vector<int> all;
+    for (auto& values : taken) {
+        all.insert(all.end(), values.begin(), values.end());
+    }
+    sort(all.begin(), all.end());
+    REQUIRE(all.size() == (size_t)(producers * perProducer));
+    for (int i = 0; i < (int)all.size(); i++) {
+        REQUIRE(all[i] == i);
+    }
+    REQUIRE(q.Size() == 0);
+}
+
+TEST_CASE("Concurrent priority queue", "[concurrent]") {
+    SECTION("Single threaded it behaves like the BST") {
+        concurrent_priorityqueue<string> cq;
+        checkLikeBst(cq, 61, 3000);
+    }
+
+    SECTION("Producers and consumers lose and duplicate nothing") {
+        concurrent_priorityqueue<int> cq;
+        checkProducersConsumers(cq);
+    }
+
+    SECTION("Polling readers do not starve producers of new priorities") {
+        concurrent_priorityqueue<int> cq;
+        cq.enqueue(-1, 1 << 30);
+        const int producers = 2;
+        const int perProducer = 2000;
+        atomic<int> produced(0);
+        atomic<bool> timedOut(false);
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(20);
+        vector<thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&, p]() {
+                for (int i = 0; i < perProducer; i++) {
+                    cq.enqueue(p * perProducer + i, p * perProducer + i);
+                }
+                produced.fetch_add(1);
+            });
+        }
+        for (int r = 0; r < 8; r++) {
+            threads.emplace_back([&]() {
+                while (produced.load() < producers) {
+                    if (chrono::steady_clock::now() > deadline) {
+                        timedOut = true;
+                        break;
+                    }
+                    cq.try_peek();
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        REQUIRE_FALSE(timedOut.load());
+        REQUIRE(cq.Size() == producers * perProducer + 1);
+        for (int i = 0; i < producers * perProducer; i++) {
+            REQUIRE(cq.dequeue() == i);
+        }
+        REQUIRE(cq.dequeue() == -1);
+    }
+}
+
+TEST_CASE("Lock-free skiplist priority queue", "[skiplist]") {
+    SECTION("Single threaded it behaves like the BST") {
+        skiplist_priorityqueue<string> sq;
+        checkLikeBst(sq, 67, 5000);
+    }
+
+    SECTION("Dequeued nodes are reclaimed while the queue lives") {
+        auto tracker = make_shared<int>(0);
+        {
+            skiplist_priorityqueue<shared_ptr<int>> sq;
+            for (int round = 0; round < 20; round++) {
+                for (int i = 0; i < 5000; i++) {
+                    sq.enqueue(tracker, i % 7);
+                }
+                while (sq.try_dequeue().has_value()) {
+                }
+            }
+            REQUIRE(tracker.use_count() < 1000);
+            sq.enqueue(tracker, 1);
+            sq.enqueue(tracker, 2);
+        }
+        REQUIRE(tracker.use_count() == 1);
+    }
+
+    SECTION("Producers and consumers lose and duplicate nothing") {
+        skiplist_priorityqueue<int> sq;
+        checkProducersConsumers(sq);
+    }
+
+    SECTION("Each consumer sees one producer's equal priorities in order") {
+        skiplist_priorityqueue<int> sq;
+        const int perProducer = 20000;
+        vector<thread> threads;
+        vector<vector<int>> taken(2);
+        atomic<int> done(0);
+        for (int p = 0; p < 2; p++) {
+            threads.emplace_back([&, p]() {
+                for (int i = 0; i < perProducer; i++) {
+                    sq.enqueue(p * perProducer + i, 5);
+                }
+                done.fetch_add(1);
+            });
+            threads.emplace_back([&, p]() {
+                int value;
+                while (done.load() < 2 || sq.Size() > 0) {
+                    if (sq.try_dequeue(value)) {
+                        taken[p].push_back(value);
+                    }
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        for (auto& values : taken) {
+            int last[2] = {-1, -1};
+            for (int value : values) {
+                int producer = value / perProducer;
+                REQUIRE(value > last[producer]);
+                last[producer] = value;
+            }
+        }
+    }
+}
+
+TEST_CASE("MultiQueue relaxed priority queue", "[multiqueue]") {
+    SECTION("One shard is a strict queue") {
+        multi_priorityqueue<string> mq(1, 1);
+        priorityqueue<string> pq;
+        REQUIRE(mq.shard_count() == 1);
+        mq.sample_rank_error(1);
+        srand(71);
+        for (int i = 0; i < 3000; i++) {
+            int pr = rand() % 40;
+            mq.enqueue(to_string(i), pr);
+            pq.enqueue(to_string(i), pr);
+            if (i % 3 == 0) {
+                REQUIRE(mq.dequeue() == pq.dequeue());
+            }
+        }
+        while (pq.Size() > 0) {
+            REQUIRE(mq.dequeue() == pq.dequeue());
+        }
+        REQUIRE(mq.Size() == 0);
+        REQUIRE(mq.dequeue() == "");
+        auto stats = mq.rank_error_stats();
+        REQUIRE(stats.samples == 3000);
+        REQUIRE(stats.mean == 0.0);
+        REQUIRE(stats.max == 0);
+    }
+
+    SECTION("Many shards keep the rank error small") {
+        multi_priorityqueue<int> mq(4, 4);
+        REQUIRE(mq.shard_count() == 16);
+        mq.sample_rank_error(1);
+        mt19937 gen(73);
+        for (int i = 0; i < 20000; i++) {
+            mq.enqueue(i, (int)(gen() % 100000));
+        }
+        multiset<int> left;
+        for (int i = 0; i < 20000; i++) {
+            left.insert(i);
+        }
+        for (int i = 0; i < 20000; i++) {
+            auto value = mq.try_dequeue();
+            REQUIRE(value.has_value());
+            REQUIRE(left.erase(*value) == 1);
+        }
+        REQUIRE_FALSE(mq.try_dequeue().has_value());
+        auto stats = mq.rank_error_stats();
+        REQUIRE(stats.samples == 20000);
+        REQUIRE(stats.mean > 0.0);
+        REQUIRE(stats.mean < 16 * 4);
+        mq.enqueue(1, 1);
+        mq.clear();
+        REQUIRE(mq.Size() == 0);
+        REQUIRE(mq.rank_error_stats().samples == 20000);
+        mq.sample_rank_error(0);
+        REQUIRE(mq.rank_error_stats().samples == 0);
+    }
+
+    SECTION("Producers and consumers lose and duplicate nothing") {
+        multi_priorityqueue<int> mq(2, 4);
+        checkProducersConsumers(mq);
+    }
+
+    SECTION("Threads retry past a shard they find busy") {
+        // One shard for four threads: most try_locks fail, and a single
+        // shard still has to give a strict order with no rank error.
+        multi_priorityqueue<int> mq(1, 1);
+        const int threadCount = 4;
+        const int perThread = 5000;
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < perThread; i++) {
+                    mq.enqueue(i * threadCount + t, i * threadCount + t);
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        REQUIRE(mq.Size() == threadCount * perThread);
+        threads.clear();
+        mq.sample_rank_error(1);
+        vector<vector<int>> taken(threadCount);
+        vector<int> misordered(threadCount, 0);
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() {
+                int value;
+                while (mq.try_dequeue(value)) {
+                    if (!taken[t].empty() && value <= taken[t].back()) {
+                        misordered[t]++;
+                    }
+                    taken[t].push_back(value);
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        vector<int> all;
+        for (int t = 0; t < threadCount; t++) {
+            REQUIRE(misordered[t] == 0);
+            all.insert(all.end(), taken[t].begin(), taken[t].end());
+        }
+        sort(all.begin(), all.end());
+        REQUIRE(all.size() == (size_t)(threadCount * perThread));
+        for (int i = 0; i < (int)all.size(); i++) {
+            REQUIRE(all[i] == i);
+        }
+        auto stats = mq.rank_error_stats();
+        REQUIRE(stats.samples == (unsigned long long)(threadCount * perThread));
+        REQUIRE(stats.max == 0);
+    }
+}
+
+TEST_CASE("Work stealing priority queue", "[stealing]") {
+    SECTION("One worker is a strict queue") {
+        stealing_priorityqueue<string> wq(1);
+        priorityqueue<string> pq;
+        REQUIRE(wq.worker_count() == 1);
+        srand(79);
+        for (int i = 0; i < 3000; i++) {
+            int pr = rand() % 40;
+            wq.enqueue(to_string(i), pr, 0);
+            pq.enqueue(to_string(i), pr);
+            if (i % 3 == 0) {
+                REQUIRE(wq.dequeue(0) == pq.dequeue());
+            }
+        }
+        while (pq.Size() > 0) {
+            REQUIRE(wq.dequeue(0) == pq.dequeue());
+        }
+        REQUIRE(wq.Size() == 0);
+        REQUIRE(wq.dequeue(0) == "");
+        REQUIRE_FALSE(wq.try_dequeue(0).has_value());
+    }
+
+    SECTION("An idle worker steals front batches in order") {
+        stealing_priorityqueue<int> wq(2, 0, 16);
+        vector<pair<int, int>> pairs;
+        mt19937 gen(83);
+        for (int i = 0; i < 1000; i++) {
+            int pr = (int)(gen() % 50);
+            wq.enqueue(i, pr, 0);
+            pairs.push_back({pr, i});
+        }
+        stable_sort(pairs.begin(), pairs.end(), [](auto& a, auto& b) {
+            return a.first < b.first;
+        });
+        for (auto& [pr, value] : pairs) {
+            REQUIRE(wq.dequeue(1) == value);
+        }
+        REQUIRE(wq.Size() == 0);
+        REQUIRE_FALSE(wq.try_dequeue(1).has_value());
+    }
+
+    SECTION("A worker steals only when it falls more than slack behind") {
+        stealing_priorityqueue<int> tight(2, 10);
+        stealing_priorityqueue<int> loose(2, 1000);
+        for (int i = 0; i < 100; i++) {
+            tight.enqueue(i, i, 1);
+            tight.enqueue(1000 + i, 100 + i, 0);
+            loose.enqueue(i, i, 1);
+            loose.enqueue(1000 + i, 100 + i, 0);
+        }
+        REQUIRE(tight.dequeue(0) == 0);
+        REQUIRE(loose.dequeue(0) == 1000);
+        REQUIRE(loose.dequeue(1) == 0);
+    }
+
+    SECTION("Slack runs the comparator's way in a max-queue") {
+        stealing_priorityqueue<int, int, greater<int>> tight(2, 10, 32, greater<int>());
+        stealing_priorityqueue<int, int, greater<int>> loose(2, 1000, 32, greater<int>());
+        for (int i = 0; i < 100; i++) {
+            tight.enqueue(i, 200 - i, 1);
+            tight.enqueue(1000 + i, 100 - i, 0);
+            loose.enqueue(i, 200 - i, 1);
+            loose.enqueue(1000 + i, 100 - i, 0);
+        }
+        REQUIRE(tight.dequeue(0) == 0);
+        REQUIRE(loose.dequeue(0) == 1000);
+        REQUIRE(loose.dequeue(1) == 0);
+        REQUIRE(loose.dequeue(0) == 1001);
+    }
+
+    SECTION("Steals reuse each shard's nodes") {
+        countingresource resource;
+        using pmrqueue = stealing_priorityqueue<int, int, less<int>, pmr::polymorphic_allocator<int>>;
+        pmrqueue wq(2, 0, 8, less<int>(), &resource);
+        int warm = 0;
+        for (int round = 0; round < 5000; round++) {
+            for (int i = 0; i < 16; i++) {
+                wq.enqueue(round * 16 + i, round * 16 + i, 0);
+            }
+            for (int i = 0; i < 16; i++) {
+                REQUIRE(wq.dequeue(1) == round * 16 + i);
+            }
+            if (round == 10) {
+                warm = resource.allocations;
+            }
+        }
+        REQUIRE(wq.Size() == 0);
+        REQUIRE(resource.allocations == warm);
+    }
+
+    SECTION("Fanning out workers lose and duplicate nothing") {
+        const int workers = 4;
+        const int total = 40000;
+        stealing_priorityqueue<int> wq(workers, 8, 8);
+        atomic<int> spawned(1);
+        atomic<int> done(0);
+        vector<vector<int>> taken(workers);
+        wq.enqueue(0, 0, 0);
+        vector<thread> threads;
+        for (int w = 0; w < workers; w++) {
+            threads.emplace_back([&, w]() {
+                int job;
+                while (done.load() < total) {
+                    if (!wq.try_dequeue(job, w)) {
+                        continue;
+                    }
+                    taken[w].push_back(job);
+                    for (int child = 0; child < 2; child++) {
+                        int id = spawned.fetch_add(1);
+                        if (id >= total) {
+                            break;
+                        }
+                        wq.enqueue(id, job % 97 + child, w);
+                    }
+                    done.fetch_add(1);
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        vector<int> all;
+        for (auto& values : taken) {
+            all.insert(all.end(), values.begin(), values.end());
+        }
+        sort(all.begin(), all.end());
+        REQUIRE(all.size() == (size_t)total);
+        for (int i = 0; i < total; i++) {
+            REQUIRE(all[i] == i);
+        }
+        REQUIRE(wq.Size() == 0);
+    }
+}
+
+// less<int> that stalls while hold is set, to keep a combiner busy
+struct gatedless {
+    static inline atomic<bool> hold{false};
+    static inline atomic<bool> waiting{false};
+    bool operator()(int a, int b) const {
+        while (hold.load()) {
+            waiting = true;
+            this_thread::yield();
+        }
+        return a < b;
+    }
+};
+
+TEST_CASE("Flat combining priority queue", "[combining]") {
+    SECTION("Single threaded it behaves like the BST") {
+        combining_priorityqueue<string> fq;
+        checkLikeBst(fq, 89, 3000);
+    }
+
+    SECTION("Producers and consumers lose and duplicate nothing") {
+        combining_priorityqueue<int> fq;
+        checkProducersConsumers(fq);
+    }
+
+    SECTION("Mixed peek and dequeue batches keep the strict order") {
+        combining_priorityqueue<int> fq;
+        const int total = 20000;
+        for (int i = total - 1; i >= 0; i--) {
+            fq.enqueue(i, i);
+        }
+        const int threadCount = 6;
+        vector<vector<int>> taken(threadCount);
+        vector<int> misordered(threadCount, 0);
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() {
+                int value;
+                while (true) {
+                    // Nothing is enqueued meanwhile, so the front only
+                    // moves back: a dequeue never returns less than a
+                    // peek before it, nor than the dequeue before it.
+                    optional<int> peeked = fq.try_peek();
+                    if (t % 2 == 0) {
+                        fq.try_peek();
+                    }
+                    if (!fq.try_dequeue(value)) {
+                        break;
+                    }
+                    if ((peeked.has_value() && value < *peeked) ||
+                        (!taken[t].empty() && value <= taken[t].back())) {
+                        misordered[t]++;
+                    }
+                    taken[t].push_back(value);
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        vector<int> all;
+        for (int t = 0; t < threadCount; t++) {
+            REQUIRE(misordered[t] == 0);
+            all.insert(all.end(), taken[t].begin(), taken[t].end());
+        }
+        sort(all.begin(), all.end());
+        REQUIRE(all.size() == (size_t)total);
+        for (int i = 0; i < total; i++) {
+            REQUIRE(all[i] == i);
+        }
+        REQUIRE(fq.Size() == 0);
+        REQUIRE_FALSE(fq.try_peek().has_value());
+    }
+
+    SECTION("An exception reaches only the request that threw") {
+        struct fragile {
+            int id = 0;
+            fragile() = default;
+            explicit fragile(int id) : id(id) {
+            }
+            fragile(const fragile& other) : id(other.id) {
+                if (id < 0) {
+                    throw runtime_error("copy");
+                }
+            }
+            fragile(fragile&&) = default;
+            fragile& operator=(const fragile& other) {
+                if (other.id < 0) {
+                    throw runtime_error("copy");
+                }
+                id = other.id;
+                return *this;
+            }
+            fragile& operator=(fragile&&) = default;
+        };
+        combining_priorityqueue<fragile, int, gatedless> fq;
+        fq.enqueue(fragile(-1), 1);
+        // The first thread combines and stalls in the comparator while the
+        // others post a peek that throws, a dequeue and an enqueue, which
+        // the next pass then applies together.
+        gatedless::hold = true;
+        thread combiner([&]() {
+            fq.enqueue(fragile(5), 5);
+        });
+        while (!gatedless::waiting) {
+            this_thread::yield();
+        }
+        bool peekThrew = false;
+        int dequeued = 0;
+        thread peeker([&]() {
+            try {
+                fq.peek();
+            }
+            catch (const runtime_error&) {
+                peekThrew = true;
+            }
+        });
+        thread dequeuer([&]() {
+            dequeued = fq.dequeue().id;
+        });
+        thread enqueuer([&]() {
+            fq.enqueue(fragile(3), 3);
+        });
+        this_thread::sleep_for(chrono::milliseconds(100));
+        gatedless::hold = false;
+        for (thread* t : {&combiner, &peeker, &dequeuer, &enqueuer}) {
+            t->join();
+        }
+        REQUIRE(peekThrew);
+        REQUIRE(dequeued == -1);
+        REQUIRE(fq.Size() == 2);
+        REQUIRE(fq.dequeue().id == 3);
+        REQUIRE(fq.dequeue().id == 5);
+    }
+}
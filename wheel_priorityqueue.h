@@ -0,0 +1,463 @@
+//  @file wheel_priorityqueue.h
+//  @brief Hierarchical timing wheel for deadline keyed queues, with the same
+//  enqueue/dequeue/peek/Size interface as priorityqueue plus O(1) cancel
+//  and batch expiry.
+//  @description The priority is a tick count that never goes below the
+//  wheel's current tick, which dequeue and advance_to move forward.  The
+//  wheel has LEVELS levels of 64 slots; level l looks at bits 6l .. 6l+5 of
+//  a deadline.  A timer sits at the level of the highest 6 bit digit in
+//  which its deadline differs from the current tick, in the slot given by
+//  that digit of the deadline, so level 0 holds the timers of the next 64
+//  ticks one slot per tick.  Every slot is a doubly linked FIFO list, which
+//  makes cancel O(1) and keeps equal deadlines in enqueue order, the same
+//  order the custom BST's duplicate link lists give.  When time reaches a
+//  slot of a higher level its timers cascade down to the levels below.  A
+//  bitmap per level finds the next non-empty slot with one countr_zero.
+//  Timers that are cancelled before they fire, the common case, never
+//  cascade at all.  Nodes come from the same nodepool as priorityqueue's.
+
+#pragma once
+
+#include "priorityqueue.h"
+
+#include <bit>
+#include <cassert>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template<typename T, typename Alloc = std::allocator<T>>
+class wheel_priorityqueue {
+public:
+    using tick = unsigned long long;
+
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = (64 + SLOT_BITS - 1) / SLOT_BITS;
+
+    struct NODE {
+        tick deadline;  // priority
+        T value;  // stored data for the p-queue
+        NODE* prev;  // previous NODE in the slot
+        NODE* next;  // next NODE in the slot
+        int slot;  // index into slots, level * SLOTS + digit
+    };
+    struct LIST {
+        NODE* head;  // first NODE, fires first
+        NODE* tail;  // last NODE, enqueue appends after it
+    };
+
+    // Only dequeue and advance_to cascade and move current, so a deadline
+    // enqueued after a peek() may still come before the peeked one.
+    LIST slots[LEVELS * SLOTS];  // LEVELS levels of SLOTS lists
+    unsigned long long occupied[LEVELS];  // bit d: slot d of the level not empty
+    tick current;  // current tick, no deadline comes before it
+    int size;  // # of elements in the pqueue
+    mutable NODE* peeked;  // earliest timer above level 0 found by peek(), nullptr if unknown
+    nodepool<NODE, Alloc> pool;  // storage for every NODE
+
+    static int digit(tick time, int level) {
+        return (int)((time >> (level * SLOT_BITS)) & (SLOTS - 1));
+    }
+
+    void link(NODE* node) {
+        int level = node->deadline == current ? 0 : (bit_width(node->deadline ^ current) - 1) / SLOT_BITS;
+        int d = digit(node->deadline, level);
+        node->slot = level * SLOTS + d;
+        LIST& list = slots[node->slot];
+        node->next = nullptr;
+        node->prev = list.tail;
+        if (list.tail == nullptr) {
+            list.head = node;
+            occupied[level] |= 1ULL << d;
+        }
+        else {
+            list.tail->next = node;
+        }
+        list.tail = node;
+    }
+
+    void unlink(NODE* node) {
+        LIST& list = slots[node->slot];
+        if (node->prev == nullptr) {
+            list.head = node->next;
+        }
+        else {
+            node->prev->next = node->next;
+        }
+        if (node->next == nullptr) {
+            list.tail = node->prev;
+        }
+        else {
+            node->next->prev = node->prev;
+        }
+        if (list.head == nullptr) {
+            occupied[node->slot / SLOTS] &= ~(1ULL << (node->slot % SLOTS));
+        }
+    }
+
+    // Moves time forward to the earliest non-empty slot, if that is no later
+    // than limit, cascading higher level slots down on the way, and returns
+    // the level 0 list holding the earliest timers.  Returns nullptr, with
+    // nothing changed beyond the cascades, when the earliest timer is after
+    // limit or the wheel is empty.
+    // O(LEVELS) per cascade; every timer cascades at most LEVELS times
+    LIST* earliest(tick limit) {
+        while (true) {
+            int level = 0;
+            while (level < LEVELS && occupied[level] == 0) {
+                level++;
+            }
+            if (level == LEVELS) {
+                return nullptr;
+            }
+            // Every timer on this level lies after the current digit (or
+            // on it, for level 0), so the lowest occupied slot is next.
+            int d = countr_zero(occupied[level]);
+            int shift = level * SLOT_BITS;
+            tick high = shift + SLOT_BITS >= 64 ? 0 : current >> (shift + SLOT_BITS) << (shift + SLOT_BITS);
+            tick start = high | ((tick)d << shift);
+            if (start > limit) {
+                return nullptr;
+            }
+            current = start;
+            if (level == 0) {
+                return &slots[d];
+            }
+            LIST& list = slots[level * SLOTS + d];
+            NODE* node = list.head;
+            list.head = nullptr;
+            list.tail = nullptr;
+            occupied[level] &= ~(1ULL << d);
+            while (node != nullptr) {
+                NODE* next = node->next;
+                link(node);
+                node = next;
+            }
+        }
+    }
+
+    // Takes the first timer off a level 0 list.
+    NODE* popFront(LIST* list) {
+        NODE* node = list->head;
+        unlink(node);
+        size--;
+        return node;
+    }
+
+    void destroyNode(NODE* node) {
+        node->~NODE();
+        pool.deallocate(node);
+    }
+
+    void reset() {
+        for (LIST& list : slots) {
+            list.head = nullptr;
+            list.tail = nullptr;
+        }
+        for (unsigned long long& bits : occupied) {
+            bits = 0;
+        }
+        current = 0;
+        size = 0;
+        peeked = nullptr;
+    }
+
+public:
+    //
+    // handle
+    //
+    // Refers to one timer, as returned by enqueue and emplace, for cancel.
+    // Valid until the timer fires (is dequeued) or is cancelled.
+    //
+    class handle {
+    public:
+        handle() : node(nullptr) {
+        }
+
+        tick deadline() const {
+            return node->deadline;
+        }
+
+        const T& value() const {
+            return node->value;
+        }
+
+        bool operator==(const handle& other) const {
+            return node == other.node;
+        }
+
+    private:
+        friend class wheel_priorityqueue;
+
+        explicit handle(NODE* node) : node(node) {
+        }
+
+        NODE* node;  // the timer's node, which never moves in memory
+    };
+
+    //
+    // default / allocator constructors:
+    //
+    // Creates an empty wheel at tick 0.
+    // O(LEVELS * SLOTS)
+    //
+    wheel_priorityqueue() {
+        reset();
+    }
+
+    explicit wheel_priorityqueue(const Alloc& alloc) : pool(alloc) {
+        reset();
+    }
+
+    //
+    // Copying is not supported: handles could not follow the copy.  Moving
+    // takes over the nodes, so handles stay valid.
+    // O(LEVELS * SLOTS)
+    //
+    wheel_priorityqueue(const wheel_priorityqueue&) = delete;
+    wheel_priorityqueue& operator=(const wheel_priorityqueue&) = delete;
+
+    wheel_priorityqueue(wheel_priorityqueue&& other) noexcept : pool(std::move(other.pool)) {
+        std::copy(std::begin(other.slots), std::end(other.slots), std::begin(slots));
+        std::copy(std::begin(other.occupied), std::end(other.occupied), std::begin(occupied));
+        current = other.current;
+        size = other.size;
+        peeked = other.peeked;
+        other.reset();
+    }
+
+    wheel_priorityqueue& operator=(wheel_priorityqueue&& other) noexcept {
+        if (this != &other) {
+            clear();
+            pool.swap(other.pool);
+            std::copy(std::begin(other.slots), std::end(other.slots), std::begin(slots));
+            std::copy(std::begin(other.occupied), std::end(other.occupied), std::begin(occupied));
+            current = other.current;
+            size = other.size;
+            peeked = other.peeked;
+            other.reset();
+        }
+        return *this;
+    }
+
+    ~wheel_priorityqueue() {
+        clear();
+    }
+
+    //
+    // clear:
+    //
+    // Cancels every timer and rewinds the wheel to tick 0.
+    // O(chunks) when T is trivially destructible, otherwise O(n)
+    //
+    void clear() {
+        if (!is_trivially_destructible<T>::value) {
+            for (LIST& list : slots) {
+                for (NODE* node = list.head; node != nullptr;) {
+                    NODE* next = node->next;
+                    node->~NODE();
+                    node = next;
+                }
+            }
+        }
+        pool.release();
+        reset();
+    }
+
+    //
+    // now:
+    //
+    // Returns the current tick.  dequeue and advance_to move it forward; a
+    // deadline may not come before it.
+    // O(1)
+    //
+    tick now() const {
+        return current;
+    }
+
+    //
+    // enqueue / emplace:
+    //
+    // Arms a timer that fires at the given tick, which must not come before
+    // now(); debug builds assert this.  Returns a handle for cancel (which
+    // may be ignored).  emplace constructs the value in place.
+    // O(1)
+    //
+    handle enqueue(const T& value, tick deadline) {
+        return emplace(deadline, value);
+    }
+
+    handle enqueue(T&& value, tick deadline) {
+        return emplace(deadline, std::move(value));
+    }
+
+    template<typename... Args>
+    handle emplace(tick deadline, Args&&... args) {
+        assert(deadline >= current && "wheel_priorityqueue: deadline before the current tick");
+        void* memory = pool.allocate();
+        NODE* node;
+        try {
+            node = ::new (memory) NODE{deadline, T(std::forward<Args>(args)...)};
+        }
+        catch (...) {
+            pool.deallocate(memory);
+            throw;
+        }
+        link(node);
+        size++;
+        if (peeked != nullptr && deadline < peeked->deadline) {
+            peeked = node;
+        }
+        return handle(node);
+    }
+
+    //
+    // cancel:
+    //
+    // Disarms the timer h refers to without firing it; h becomes invalid.
+    // O(1)
+    //
+    void cancel(handle h) {
+        if (h.node == peeked) {
+            peeked = nullptr;
+        }
+        unlink(h.node);
+        size--;
+        destroyNode(h.node);
+    }
+
+    //
+    // advance_to:
+    //
+    // Moves the current tick forward to the given one, firing every timer
+    // whose deadline is not after it: each is removed and its value passed
+    // to callback, in deadline order, equal deadlines in enqueue order.
+    // callback may enqueue new timers (those due by the given tick fire in
+    // this same call) and cancel pending ones.  Returns the # of timers
+    // fired.
+    // O(k + LEVELS) plus cascading, amortized O(LEVELS) per timer, for k
+    // fired timers
+    //
+    template<typename Callback>
+    size_t advance_to(tick time, Callback&& callback) {
+        size_t fired = 0;
+        if (time < current) {
+            return fired;
+        }
+        peeked = nullptr;
+        while (LIST* list = earliest(time)) {
+            while (list->head != nullptr) {
+                NODE* node = popFront(list);
+                T value = std::move(node->value);
+                destroyNode(node);
+                fired++;
+                callback(std::move(value));
+            }
+        }
+        current = time;
+        return fired;
+    }
+
+    //
+    // dequeue:
+    //
+    // Fires the earliest timer: moves the current tick to its deadline,
+    // removes it and returns its value.  Returns T() when empty.
+    // O(LEVELS) amortized, see advance_to
+    //
+    T dequeue() {
+        peeked = nullptr;
+        LIST* list = earliest(~(tick)0);
+        if (list == nullptr) {
+            return T();
+        }
+        NODE* node = popFront(list);
+        T valueOut = std::move(node->value);
+        destroyNode(node);
+        return valueOut;
+    }
+
+    //
+    // peek:
+    //
+    // returns a reference to the value of the earliest timer without firing
+    // it.  Does not move the current tick or cascade; when the earliest
+    // timer is above level 0 its slot is searched in place, and the result
+    // kept until that timer is fired or cancelled.
+    // O(LEVELS), plus O(k) for a slot of k timers searched at most once
+    // per dequeue
+    //
+    // The queue must not be empty; use try_peek when it might be.
+    //
+    const T& peek() const {
+        if (occupied[0] != 0) {
+            return slots[countr_zero(occupied[0])].head->value;
+        }
+        if (peeked == nullptr) {
+            int level = 1;
+            while (occupied[level] == 0) {
+                level++;
+            }
+            NODE* node = slots[level * SLOTS + countr_zero(occupied[level])].head;
+            peeked = node;
+            for (; node != nullptr; node = node->next) {
+                if (node->deadline < peeked->deadline) {
+                    peeked = node;
+                }
+            }
+        }
+        return peeked->value;
+    }
+
+    //
+    // try_peek / try_dequeue:
+    //
+    // Same as in priorityqueue: false (or an empty optional) for an empty
+    // queue, without constructing a T.
+    //
+    bool try_peek(T& valueOut) const {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = peek();
+        return true;
+    }
+
+    optional<T> try_peek() const {
+        if (size == 0) {
+            return nullopt;
+        }
+        return peek();
+    }
+
+    bool try_dequeue(T& valueOut) {
+        if (size == 0) {
+            return false;
+        }
+        valueOut = dequeue();
+        return true;
+    }
+
+    optional<T> try_dequeue() {
+        if (size == 0) {
+            return nullopt;
+        }
+        return dequeue();
+    }
+
+    //
+    // Size:
+    //
+    // Returns the # of elements in the priority queue, 0 if empty.
+    // O(1)
+    //
+    int Size() const {
+        return size;
+    }
+};